@@ -6,6 +6,9 @@ set code=%curDir%\src
 pushd gebouw
 
 cl %opts% %code%\main.cpp -Fesatisfactory-calc.exe /link -incremental:no -opt:ref winmm.lib
+satisfactory-calc.exe -f %curDir%\data\recipes.txt -H builtin_book.h
+cl %opts% -I. -DSATISFACTORY_CALC_BUILTIN_BOOK=1 %code%\main.cpp -Fesatisfactory-calc.exe /link -incremental:no -opt:ref winmm.lib
 cl %opts% %code%\splitter.cpp -Fesplitter-calc.exe /link -incremental:no -opt:ref winmm.lib
+cl %opts% -O2 %code%\benchmark.cpp -Fesatisfactory-bench.exe /link -incremental:no -opt:ref winmm.lib
 
 popd
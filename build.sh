@@ -8,5 +8,18 @@ mkdir -p gebouw
 cd gebouw > /dev/null
 
 echo Building satisfactory calc
-clang++ $opts $code/src/main.cpp -o satisfactory-calc
+clang++ $opts $code/src/main.cpp -o satisfactory-calc -pthread
+
+echo Building satisfactory calc with the built-in recipe book
+./satisfactory-calc -f $code/data/recipes.txt -H builtin_book.h
+clang++ $opts -I. -DSATISFACTORY_CALC_BUILTIN_BOOK=1 $code/src/main.cpp -o satisfactory-calc -pthread
+
+echo Building splitter calc
+clang++ $opts $code/src/splitter.cpp -o splitter-calc
+
+echo Building benchmarks
+clang++ $opts -O2 $code/src/benchmark.cpp -o satisfactory-bench -pthread
 cd $code > /dev/null
+
+echo Checking the plan session
+gebouw/satisfactory-calc -f data/recipes.txt -b data/session_check.txt 2>&1 | diff - data/session_check.out || exit 1
@@ -0,0 +1,434 @@
+// NOTE(michiel): Microbenchmarks for the calculator. Every case runs for a fixed time budget, split over a couple of
+// rounds, and reports the median time per operation. The output is one 'name ns_per_op ops' line per case, so two runs
+// can be diffed, and -c compares against an earlier run and fails if a case got slower than the allowed regression.
+//
+// Usage: satisfactory-bench [-f <recipe book>] [-g <generator spec>] [-t <milliseconds per case>] [-c <baseline>]
+//                           [-r <percent>] [filter]
+
+#define SATISFACTORY_CALC_NO_MAIN 1
+#include "main.cpp"
+
+#if !_MSC_VER
+#include <time.h>
+#endif
+
+#define BENCHMARK_ROUNDS     5
+#define MAX_BENCHMARK_CASES  64
+
+enum BenchmarkKind
+{
+    Benchmark_Register,
+    Benchmark_Lookup,
+    Benchmark_TotalProduction,
+    Benchmark_TotalProductionCold,
+    Benchmark_PrintOverproduce,
+    Benchmark_Dotfile,
+    Benchmark_Explore,
+    Benchmark_Search,
+    Benchmark_Session,
+};
+
+struct BenchmarkCase
+{
+    char name[64];
+    BenchmarkKind kind;
+    Calculator *calculator;
+    String book;            // NOTE(michiel): The recipe book text, for Benchmark_Register
+    String query;           // NOTE(michiel): The text to complete, for Benchmark_Search
+    PlanSession *session;   // NOTE(michiel): For Benchmark_Session
+    Recipe *recipe;
+    ProductionTarget target;
+
+    f64 nanosecondsPerOp;
+    u64 opCount;
+};
+
+struct BenchmarkState
+{
+    QueryArena arena;
+    OutputBuffer buffer;
+    OutputBuffer errors;
+    TextOutput output;
+    CostTest *cost;         // NOTE(michiel): Sized for the calculator with the most items
+    Interns strings;        // NOTE(michiel): Shared by the registration rounds, so they do not pile up names
+    volatile u64 sink;
+};
+
+internal u64
+get_nanoseconds(void)
+{
+#if _MSC_VER
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    u64 result = (u64)((f64)counter.QuadPart * 1.0e9 / (f64)frequency.QuadPart);
+#else
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    u64 result = (u64)time.tv_sec * 1000000000ULL + (u64)time.tv_nsec;
+#endif
+    return result;
+}
+
+// NOTE(michiel): Expects a cleared calculator, apart from the interned strings
+internal b32
+load_book_text(Calculator *calculator, String book)
+{
+    b32 result = parse_recipe_book(calculator, static_string("benchmark"), book);
+    if (result)
+    {
+        build_recipe_index(calculator);
+    }
+    return result;
+}
+
+// NOTE(michiel): Leaves the interned strings alone, the caller keeps those
+internal void
+free_calculator(Calculator *calculator)
+{
+    reset_unit_costs(calculator);
+    free(calculator->unitCosts);
+    free(calculator->itemRecipes);
+    free(calculator->producers);
+    free(calculator->itemNames);
+    free(calculator->itemMap);
+    free(calculator->recipes);
+    free(calculator->recipeItems);
+    free_name_index(calculator->nameIndex);
+    free_recipe_loops(calculator->recipeLoops);
+}
+
+internal u64
+run_benchmark_op(BenchmarkState *state, BenchmarkCase *bench)
+{
+    u64 result = 1;
+    Calculator *calculator = bench->calculator;
+    TextOutput output = state->output;
+    switch (bench->kind)
+    {
+        case Benchmark_Register:
+        {
+            Calculator scratch = {};
+            scratch.strings = state->strings;
+            load_book_text(&scratch, bench->book);
+            state->sink += scratch.recipeCount;
+            state->strings = scratch.strings;
+            free_calculator(&scratch);
+        } break;
+
+        case Benchmark_Lookup:
+        {
+            // NOTE(michiel): One op is one name to recipes lookup, over every item in the book
+            for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+            {
+                RecipeList recipes = get_recipes(calculator, find_item(calculator, calculator->itemNames[itemId]));
+                state->sink += recipes.count;
+            }
+            result = calculator->itemCount - 1;
+        } break;
+
+        case Benchmark_TotalProduction:
+        case Benchmark_TotalProductionCold:
+        {
+            if (bench->kind == Benchmark_TotalProductionCold)
+            {
+                reset_unit_costs(calculator);
+            }
+            calc_total_production(calculator, state->cost, bench->recipe, bench->target.itemsPerMinute);
+            state->sink += state->cost->produceCount;
+            reset_cost(state->cost);
+        } break;
+
+        case Benchmark_PrintOverproduce:
+        {
+            print_recipe(calculator, output, state->cost, bench->recipe, bench->target.itemsPerMinute, false, true);
+            output_input_cost(state->cost);
+            print_cost(calculator, output, state->cost);
+            reset_cost(state->cost);
+        } break;
+
+        case Benchmark_Dotfile:
+        {
+            print_dotfile(calculator, output, 1, &bench->recipe, &bench->target);
+        } break;
+
+        case Benchmark_Explore:
+        {
+            explore_recipes(calculator, output, state->cost, 1, &bench->target, Objective_Resources, 3, 1);
+            reset_cost(state->cost);
+        } break;
+
+        case Benchmark_Search:
+        {
+            u32 itemIds[MAX_FIND_RESULTS];
+            state->sink += find_item_names(calculator, bench->query, MAX_FIND_RESULTS, itemIds);
+        } break;
+
+        case Benchmark_Session:
+        {
+            // NOTE(michiel): One op is one edit session, from the first target to the cleared plan
+            QueryOptions defaults = {};
+            const char *lines[] = {":target computer 10", ":use plastic 2", ":show", ":clear"};
+            for (u32 lineIdx = 0; lineIdx < array_count(lines); ++lineIdx)
+            {
+                state->sink += run_session_line(calculator, output, bench->session, &defaults, string(lines[lineIdx]));
+            }
+        } break;
+
+        INVALID_DEFAULT_CASE;
+    }
+    state->sink += state->buffer.size;
+    state->buffer.size = 0;
+    state->errors.size = 0;
+    reset_arena(&state->arena);
+    return result;
+}
+
+internal int
+compare_f64(const void *a, const void *b)
+{
+    f64 left = *(f64 *)a;
+    f64 right = *(f64 *)b;
+    return (left < right) ? -1 : ((left > right) ? 1 : 0);
+}
+
+internal void
+run_benchmark(BenchmarkState *state, BenchmarkCase *bench, u64 budgetNanoseconds)
+{
+    // NOTE(michiel): One op up front, so lazy tables and buffers are not part of the timing
+    run_benchmark_op(state, bench);
+
+    f64 roundTimes[BENCHMARK_ROUNDS];
+    u64 totalOps = 0;
+    for (u32 round = 0; round < BENCHMARK_ROUNDS; ++round)
+    {
+        u64 opCount = 0;
+        u64 start = get_nanoseconds();
+        u64 elapsed = 0;
+        do
+        {
+            opCount += run_benchmark_op(state, bench);
+            elapsed = get_nanoseconds() - start;
+        } while (elapsed < budgetNanoseconds / BENCHMARK_ROUNDS);
+        roundTimes[round] = (f64)elapsed / (f64)opCount;
+        totalOps += opCount;
+    }
+    qsort(roundTimes, BENCHMARK_ROUNDS, sizeof(f64), compare_f64);
+    bench->nanosecondsPerOp = roundTimes[BENCHMARK_ROUNDS / 2];
+    bench->opCount = totalOps;
+}
+
+internal BenchmarkCase *
+add_benchmark(BenchmarkCase *cases, u32 *caseCount, BenchmarkKind kind, Calculator *calculator, const char *name,
+              const char *targetName = 0)
+{
+    i_expect(*caseCount < MAX_BENCHMARK_CASES);
+    BenchmarkCase *result = cases + (*caseCount)++;
+    *result = {};
+    result->kind = kind;
+    result->calculator = calculator;
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    if (targetName)
+    {
+        String target = string(targetName);
+        RecipeList recipes = get_recipes(calculator, find_item(calculator, target));
+        i_expect(recipes.count);
+        result->recipe = recipes.recipes[0];
+        result->target.itemId = result->recipe->output.id;
+        result->target.itemsPerMinute = result->recipe->output.itemsPerMinute;
+
+        // NOTE(michiel): The names go in the output, keep them free of spaces. A name with a '/' is already complete.
+        if (!strchr(name, '/'))
+        {
+            snprintf(result->name, sizeof(result->name), "%s/%s", name, targetName);
+        }
+        for (char *at = result->name; *at; ++at)
+        {
+            if (*at == ' ')
+            {
+                *at = '_';
+            }
+        }
+    }
+    return result;
+}
+
+// NOTE(michiel): Returns the ns/op of the case in the baseline output, or 0 if it is not in there
+internal f64
+find_baseline(String baseline, const char *name)
+{
+    f64 result = 0.0;
+    String name0 = string(name);
+    String rest = baseline;
+    while (rest.size)
+    {
+        String line = trim_spaces(split_off(&rest, static_string("\n")));
+        String lineName = split_off(&line, static_string(" "));
+        if ((line.size) && (lineName == name0))
+        {
+            result = float_from_string(trim_spaces(line));
+            break;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    const char *recipeFile = getenv("SATISFACTORY_RECIPES");
+    const char *baselineFile = 0;
+    const char *generatorSpec = "";
+    const char *filter = 0;
+    f64 budgetMilliseconds = 250.0;
+    f64 allowedRegression = 15.0;
+
+    char defaultBook[4096];
+    if (!recipeFile)
+    {
+        recipeFile = get_default_book_path(argv[0], defaultBook, sizeof(defaultBook));
+    }
+
+    for (s32 argIdx = 1; argIdx < argc; ++argIdx)
+    {
+        char *argument = argv[argIdx];
+        if ((argument[0] == '-') && (argIdx + 1 < argc))
+        {
+            if (argument[1] == 'f') {
+                recipeFile = argv[++argIdx];
+            } else if (argument[1] == 'g') {
+                generatorSpec = argv[++argIdx];
+            } else if (argument[1] == 't') {
+                budgetMilliseconds = atof(argv[++argIdx]);
+            } else if (argument[1] == 'c') {
+                baselineFile = argv[++argIdx];
+            } else if (argument[1] == 'r') {
+                allowedRegression = atof(argv[++argIdx]);
+            } else {
+                fprintf(stderr, "Usage: %s [-f <recipe book>] [-g <generator spec>] [-t <milliseconds per case>] [-c <baseline>] [-r <percent>] [filter]\n", argv[0]);
+                return 1;
+            }
+        }
+        else
+        {
+            filter = argument;
+        }
+    }
+
+    umm bookSize;
+    void *bookMemory = map_file(recipeFile, &bookSize);
+    if (!bookMemory || ((bookSize >= sizeof(u32)) && (*(u32 *)bookMemory == SNAPSHOT_MAGIC)))
+    {
+        fprintf(stderr, "Could not open '%s' as a text recipe book\n", recipeFile);
+        return 1;
+    }
+    String book = {bookSize, (u8 *)bookMemory};
+
+    BenchmarkState state = {};
+    state.output.buffer = &state.buffer;
+    state.output.errors = &state.errors;
+    state.output.arena = &state.arena;
+
+    SyntheticSpec spec;
+    if (!parse_synthetic_spec(generatorSpec, &spec))
+    {
+        return 1;
+    }
+    OutputBuffer syntheticBuffer = {};
+    generate_synthetic_book(&syntheticBuffer, &spec);
+    String syntheticBook = {syntheticBuffer.size, syntheticBuffer.data};
+
+    Calculator calculator = {};
+    Calculator synthetic = {};
+    if (!load_book_text(&calculator, book) || !load_book_text(&synthetic, syntheticBook))
+    {
+        return 1;
+    }
+    u32 maxItemCount = (calculator.itemCount > synthetic.itemCount) ? calculator.itemCount : synthetic.itemCount;
+    state.cost = allocate_cost(maxItemCount);
+
+    // NOTE(michiel): Fixed targets, from a short tree to the deepest ones in the book, then the synthetic graph
+    const char *targetNames[] = {"reinforced iron plate", "computer", "heavy modular frame", "supercomputer"};
+    // NOTE(michiel): The top item has the deepest tree, the middle one keeps the number of alternates to explore sane
+    char syntheticTop[32];
+    char syntheticMiddle[32];
+    snprintf(syntheticTop, sizeof(syntheticTop), "item %u", spec.itemCount - 1);
+    snprintf(syntheticMiddle, sizeof(syntheticMiddle), "item %u",
+             get_synthetic_layer_start(&spec, (spec.depth > 1) ? spec.depth / 2 : 1));
+
+    BenchmarkCase cases[MAX_BENCHMARK_CASES];
+    u32 caseCount = 0;
+    add_benchmark(cases, &caseCount, Benchmark_Register, &calculator, "register/book")->book = book;
+    add_benchmark(cases, &caseCount, Benchmark_Register, &synthetic, "register/synthetic")->book = syntheticBook;
+    add_benchmark(cases, &caseCount, Benchmark_Lookup, &calculator, "lookup/book");
+    add_benchmark(cases, &caseCount, Benchmark_Lookup, &synthetic, "lookup/synthetic");
+    // NOTE(michiel): A typo, so the prefix completion comes up short and the fuzzy search fills the rest
+    add_benchmark(cases, &caseCount, Benchmark_Search, &calculator, "search/book")->query = static_string("compter");
+    add_benchmark(cases, &caseCount, Benchmark_Search, &synthetic, "search/synthetic")->query = static_string("itme 12");
+    for (u32 targetIdx = 0; targetIdx < array_count(targetNames); ++targetIdx)
+    {
+        add_benchmark(cases, &caseCount, Benchmark_TotalProduction, &calculator, "total", targetNames[targetIdx]);
+        add_benchmark(cases, &caseCount, Benchmark_TotalProductionCold, &calculator, "total_cold", targetNames[targetIdx]);
+        add_benchmark(cases, &caseCount, Benchmark_PrintOverproduce, &calculator, "print_o", targetNames[targetIdx]);
+        add_benchmark(cases, &caseCount, Benchmark_Dotfile, &calculator, "dot", targetNames[targetIdx]);
+    }
+    add_benchmark(cases, &caseCount, Benchmark_Explore, &calculator, "explore", "computer");
+    add_benchmark(cases, &caseCount, Benchmark_Explore, &calculator, "explore", "heavy modular frame");
+    add_benchmark(cases, &caseCount, Benchmark_Session, &calculator, "session/use_show")->session =
+        allocate_session(calculator.itemCount);
+    add_benchmark(cases, &caseCount, Benchmark_TotalProduction, &synthetic, "total/synthetic_top", syntheticTop);
+    add_benchmark(cases, &caseCount, Benchmark_TotalProductionCold, &synthetic, "total_cold/synthetic_top", syntheticTop);
+    add_benchmark(cases, &caseCount, Benchmark_PrintOverproduce, &synthetic, "print_o/synthetic_middle", syntheticMiddle);
+    add_benchmark(cases, &caseCount, Benchmark_Dotfile, &synthetic, "dot/synthetic_top", syntheticTop);
+    add_benchmark(cases, &caseCount, Benchmark_Explore, &synthetic, "explore/synthetic_middle", syntheticMiddle);
+
+    String baseline = {};
+    if (baselineFile)
+    {
+        baseline.data = (u8 *)map_file(baselineFile, &baseline.size);
+        if (!baseline.data)
+        {
+            fprintf(stderr, "Could not open baseline '%s'\n", baselineFile);
+            return 1;
+        }
+    }
+
+    printf("# %s: %u recipes, synthetic '%s': %u recipes, %.0f ms per case, median of %u rounds\n", recipeFile,
+           calculator.recipeCount, generatorSpec, synthetic.recipeCount, budgetMilliseconds, BENCHMARK_ROUNDS);
+    printf("# name ns_per_op ops%s\n", baselineFile ? " change" : "");
+
+    int result = 0;
+    for (u32 caseIdx = 0; caseIdx < caseCount; ++caseIdx)
+    {
+        BenchmarkCase *bench = cases + caseIdx;
+        if (filter && !strstr(bench->name, filter))
+        {
+            continue;
+        }
+
+        run_benchmark(&state, bench, (u64)(budgetMilliseconds * 1.0e6));
+        printf("%s %.1f %llu", bench->name, bench->nanosecondsPerOp, (unsigned long long)bench->opCount);
+        if (baselineFile)
+        {
+            f64 before = find_baseline(baseline, bench->name);
+            if (before > 0.0)
+            {
+                f64 change = 100.0 * (bench->nanosecondsPerOp - before) / before;
+                printf(" %+.1f%%", change);
+                if (change > allowedRegression)
+                {
+                    printf(" REGRESSION");
+                    result = 1;
+                }
+            }
+            else
+            {
+                printf(" new");
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    return result;
+}
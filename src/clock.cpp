@@ -0,0 +1,172 @@
+// NOTE(michiel): Turns the fractional building multipliers of a solved plan into whole buildings with a clock speed
+// each. A building draws power * clock^1.321928 (the exponent is log2(2.5)), so print_cost, which scales the power
+// linearly, is too high for underclocked and too low for overclocked buildings. Clocks go from 1% to 100%, every
+// power shard adds 50% on top of that for one building, up to 3 shards for 250%.
+// The draw is convex in the clock, so for a given number of buildings running them all at the same clock draws the
+// least. With a cap per building (the shards it got) the clocks are filled up evenly to the caps. Neither mode looks
+// for the least power overall, that would always want more buildings at lower clocks.
+
+#define CLOCK_POWER_EXPONENT 1.321928
+#define MAX_SHARDS_PER_BUILDING 3
+
+enum ClockObjective
+{
+    Clock_None,
+    Clock_Whole,        // NOTE(michiel): The multiplier rounded up in buildings, all underclocked, no shards
+    Clock_Buildings,    // NOTE(michiel): As few buildings as the shards allow, then as few shards, clocks filled evenly
+};
+
+struct ClockGroup
+{
+    u32 buildingCount;
+    u32 shardsPerBuilding;
+    f64 clock;
+};
+
+// NOTE(michiel): At most two groups, the buildings with one shard more than the others run at a higher clock
+struct ClockSetting
+{
+    u32 buildingCount;
+    u32 shardCount;
+    f64 power;
+    u32 groupCount;
+    ClockGroup groups[2];
+};
+
+internal f64
+get_clock_power(f64 basePower, f64 clock)
+{
+    return basePower * pow(clock, CLOCK_POWER_EXPONENT);
+}
+
+internal u32
+get_clock_shards(f64 clock)
+{
+    // NOTE(michiel): The epsilon keeps exactly 150% at one shard
+    f64 shards = ceil((clock - 1.0) * 2.0 - 1.0e-9);
+    return (shards > 0.0) ? (u32)shards : 0;
+}
+
+internal ClockSetting
+solve_clock_setting(f64 ratio, f64 basePower, ClockObjective objective)
+{
+    ClockSetting result = {};
+
+    u32 shardCount = 0;
+    if (objective == Clock_Buildings)
+    {
+        f64 maxClock = 1.0 + 0.5 * MAX_SHARDS_PER_BUILDING;
+        result.buildingCount = (u32)ceil(ratio / maxClock - 1.0e-9);
+        if (result.buildingCount == 0)
+        {
+            result.buildingCount = 1;
+        }
+        if (ratio > result.buildingCount)
+        {
+            shardCount = (u32)ceil((ratio - result.buildingCount) * 2.0 - 1.0e-9);
+        }
+    }
+    else
+    {
+        result.buildingCount = (u32)ceil(ratio - 1.0e-9);
+        if (result.buildingCount == 0)
+        {
+            result.buildingCount = 1;
+        }
+    }
+
+    // NOTE(michiel): Spread the shards as evenly as possible, then fill the clocks up to the caps that gives
+    u32 lowShards = shardCount / result.buildingCount;
+    u32 highCount = shardCount % result.buildingCount;
+    u32 lowCount = result.buildingCount - highCount;
+    f64 lowCap = 1.0 + 0.5 * lowShards;
+
+    f64 lowClock = ratio / result.buildingCount;
+    f64 highClock = lowClock;
+    if (highCount && (lowClock > lowCap))
+    {
+        lowClock = lowCap;
+        highClock = (ratio - lowCount * lowCap) / highCount;
+    }
+
+    result.groups[result.groupCount++] = {lowCount, get_clock_shards(lowClock), lowClock};
+    if (highCount)
+    {
+        result.groups[result.groupCount++] = {highCount, get_clock_shards(highClock), highClock};
+    }
+
+    for (u32 groupIdx = 0; groupIdx < result.groupCount; ++groupIdx)
+    {
+        ClockGroup *group = result.groups + groupIdx;
+        result.shardCount += group->buildingCount * group->shardsPerBuilding;
+        result.power += group->buildingCount * get_clock_power(basePower, group->clock);
+    }
+
+    return result;
+}
+
+// NOTE(michiel): Prints the percentage with up to 4 decimals, the precision the game takes
+internal void
+output_clock(OutputBuffer *buffer, f64 clock)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.4f", clock * 100.0);
+    u32 size = (u32)strlen(text);
+    while (text[size - 1] == '0')
+    {
+        --size;
+    }
+    if (text[size - 1] == '.')
+    {
+        --size;
+    }
+    output_fmt(buffer, "%.*s%%", size, text);
+}
+
+internal void
+print_clock_speeds(Calculator *calculator, TextOutput output, SolvedPlan *plan, ClockObjective objective)
+{
+    print_line(output, "Clock speeds (%s):", (objective == Clock_Whole) ? "whole buildings, no shards" : "fewest buildings");
+    ++output.indent;
+
+    u32 totalBuildings = 0;
+    u32 totalShards = 0;
+    f64 totalRatio = 0.0;
+    f64 totalPower = 0.0;
+    f64 linearPower = 0.0;
+    for (u32 recipeIdx = 0; recipeIdx < plan->recipeCount; ++recipeIdx)
+    {
+        Recipe *recipe = plan->recipes[recipeIdx];
+        f64 ratio = to_f64(plan->ratios[recipeIdx]);
+        f64 basePower = calculator->buildings[recipe->building].power;
+        ClockSetting setting = solve_clock_setting(ratio, basePower, objective);
+
+        output_spaces(output.buffer, output.indent * 2);
+        output_fmt(output.buffer, "%.*s:", STR_FMT(recipe->output.name));
+        for (u32 groupIdx = 0; groupIdx < setting.groupCount; ++groupIdx)
+        {
+            ClockGroup *group = setting.groups + groupIdx;
+            String building = string_from_building(calculator, recipe->building, group->buildingCount == 1);
+            output_fmt(output.buffer, "%s %u %.*s at ", groupIdx ? "," : "", group->buildingCount, STR_FMT(building));
+            output_clock(output.buffer, group->clock);
+            if (group->shardsPerBuilding)
+            {
+                output_fmt(output.buffer, " (%u shard%s%s)", group->shardsPerBuilding,
+                           (group->shardsPerBuilding == 1) ? "" : "s", (group->buildingCount == 1) ? "" : " each");
+            }
+        }
+        output_fmt(output.buffer, ", %.1f MW\n", setting.power);
+
+        totalBuildings += setting.buildingCount;
+        totalShards += setting.shardCount;
+        totalRatio += ratio;
+        totalPower += setting.power;
+        linearPower += ratio * basePower;
+    }
+
+    --output.indent;
+    output_string(output.buffer, static_string("\n"));
+    print_line(output, "Buildings: %u (%.2fx at 100%%)", totalBuildings, totalRatio);
+    print_line(output, "Power shards: %u", totalShards);
+    print_line(output, "Total power usage: %5.1fMW (linear estimate %5.1fMW)", totalPower, linearPower);
+}
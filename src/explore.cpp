@@ -0,0 +1,624 @@
+// NOTE(michiel): Explores every combination of alternate recipes for a query. A combination picks one recipe per item
+// (choices[itemId] is the recipe index + 1, 0 if not picked yet). A task is a partial combination, it gets expanded
+// until the first item that still has to pick one of its alternates and then splits into one task per alternate.
+// Tasks live on per worker deques, a worker takes its newest task and steals the oldest task of another worker
+// when it runs dry. Every worker keeps its own cost and best plans, they are merged when the pool is done.
+//
+// Tasks are pruned with branch and bound. The bound of a partial plan is the part of the score that can only grow
+// (building counts, raw resources that no recipe gives as a byproduct) plus the cheapest possible cost of the
+// subtrees that still have to pick an alternate. Once that exceeds the score of the worst plan we keep, the task and
+// all of its children can not make the cut.
+
+#if _MSC_VER
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#define MAX_EXPLORE_PLANS   16
+#define MAX_EXPLORE_THREADS 256
+#define EXPLORE_LOOP        0xFFFFFFFF
+
+#if _MSC_VER
+typedef CRITICAL_SECTION ExploreMutex;
+internal void init_explore_mutex(ExploreMutex *mutex) { InitializeCriticalSection(mutex); }
+internal void free_explore_mutex(ExploreMutex *mutex) { DeleteCriticalSection(mutex); }
+internal void lock_explore_mutex(ExploreMutex *mutex) { EnterCriticalSection(mutex); }
+internal void unlock_explore_mutex(ExploreMutex *mutex) { LeaveCriticalSection(mutex); }
+internal s64 explore_atomic_add(volatile s64 *value, s64 addend) { return InterlockedExchangeAdd64(value, addend) + addend; }
+internal void explore_yield(void) { SwitchToThread(); }
+#else
+typedef pthread_mutex_t ExploreMutex;
+internal void init_explore_mutex(ExploreMutex *mutex) { pthread_mutex_init(mutex, 0); }
+internal void free_explore_mutex(ExploreMutex *mutex) { pthread_mutex_destroy(mutex); }
+internal void lock_explore_mutex(ExploreMutex *mutex) { pthread_mutex_lock(mutex); }
+internal void unlock_explore_mutex(ExploreMutex *mutex) { pthread_mutex_unlock(mutex); }
+internal s64 explore_atomic_add(volatile s64 *value, s64 addend) { return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST); }
+internal void explore_yield(void) { sched_yield(); }
+#endif
+
+internal u32
+get_processor_count(void)
+{
+#if _MSC_VER
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    u32 result = info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 result = (count > 0) ? (u32)count : 1;
+#endif
+    return result;
+}
+
+struct ExploreQueue
+{
+    ExploreMutex mutex;
+    // NOTE(michiel): Ring buffer of choice arrays, the owner pushes and pops at the back, thieves pop at the front
+    u32 first;
+    u32 count;
+    u32 maxCount;
+    u16 **tasks;
+};
+
+struct ExplorePlan
+{
+    f64 score;
+    u16 *choices;
+};
+
+struct ExplorePool;
+
+struct ExploreWorker
+{
+    ExplorePool *pool;
+    u32 index;
+    ExploreQueue queue;
+
+    CostTest *cost;
+    u8 *onPath;
+
+    u32 planCount;
+    ExplorePlan plans[MAX_EXPLORE_PLANS];
+
+    u64 expandedCount;
+    u64 completeCount;
+    u64 prunedCount;
+};
+
+struct ExplorePool
+{
+    Calculator *calculator;
+    u32 targetCount;
+    ProductionTarget *targets;
+    OptimizeObjective objective;
+    u32 maxPlanCount;
+
+    volatile s64 pendingCount; // NOTE(michiel): Tasks pushed but not finished yet, the pool is done when it hits 0
+
+    b32 prune;
+    f64 *itemBounds;   // NOTE(michiel): Lower bound of the score to make 1 item per minute, for any recipe choice
+    u8 *boundedItems;  // NOTE(michiel): Raw resources that count in the partial bound
+    ExploreMutex boundMutex;
+    f64 bestBound;     // NOTE(michiel): Score of the worst kept plan, once some worker has kept enough plans
+
+    u32 workerCount;
+    ExploreWorker *workers;
+};
+
+internal void
+push_explore_task(ExploreWorker *worker, u16 *choices)
+{
+    explore_atomic_add(&worker->pool->pendingCount, 1);
+
+    ExploreQueue *queue = &worker->queue;
+    lock_explore_mutex(&queue->mutex);
+    if (queue->count == queue->maxCount)
+    {
+        u32 newMaxCount = queue->maxCount ? 2 * queue->maxCount : 64;
+        u16 **newTasks = (u16 **)malloc(sizeof(u16 *) * newMaxCount);
+        for (u32 taskIdx = 0; taskIdx < queue->count; ++taskIdx)
+        {
+            newTasks[taskIdx] = queue->tasks[(queue->first + taskIdx) % queue->maxCount];
+        }
+        free(queue->tasks);
+        queue->tasks = newTasks;
+        queue->maxCount = newMaxCount;
+        queue->first = 0;
+    }
+    queue->tasks[(queue->first + queue->count++) % queue->maxCount] = choices;
+    unlock_explore_mutex(&queue->mutex);
+}
+
+internal u16 *
+pop_explore_task(ExploreQueue *queue, b32 steal)
+{
+    u16 *result = 0;
+    lock_explore_mutex(&queue->mutex);
+    if (queue->count)
+    {
+        if (steal)
+        {
+            result = queue->tasks[queue->first];
+            queue->first = (queue->first + 1) % queue->maxCount;
+        }
+        else
+        {
+            result = queue->tasks[(queue->first + queue->count - 1) % queue->maxCount];
+        }
+        --queue->count;
+    }
+    unlock_explore_mutex(&queue->mutex);
+    return result;
+}
+
+// NOTE(michiel): Adds the recipe tree to the worker cost. Returns 0 if the tree is complete, EXPLORE_LOOP if the
+// choices make a recipe depend on its own output, or the first item that still has to pick an alternate. Subtrees
+// that have to pick are skipped, their lower bound is added to unexpandedBound.
+internal u32
+explore_recipe(Calculator *calculator, ExploreWorker *worker, u16 *choices, Recipe *recipe, Rate expectedPerMinute,
+               f64 *unexpandedBound)
+{
+    u32 result = 0;
+    Rate ratio = expectedPerMinute / recipe->output.itemsPerMinute;
+    add_recipe_cost(worker->cost, recipe, ratio);
+
+    worker->onPath[recipe->output.id] = 1;
+    for (u32 inputIdx = 0; (result != EXPLORE_LOOP) && (inputIdx < recipe->inputCount); ++inputIdx)
+    {
+        Item *input = recipe->inputs + inputIdx;
+        RecipeList inputRecipes = get_recipes(calculator, input->id);
+        if (inputRecipes.count)
+        {
+            Rate expectedInput = input->itemsPerMinute * ratio;
+            if (worker->onPath[input->id])
+            {
+                result = EXPLORE_LOOP;
+            }
+            else if ((inputRecipes.count > 1) && !choices[input->id])
+            {
+                if (!result)
+                {
+                    result = input->id;
+                }
+                *unexpandedBound += worker->pool->itemBounds[input->id] * to_f64(expectedInput);
+            }
+            else
+            {
+                u32 branchItem = explore_recipe(calculator, worker, choices, get_chosen_recipe(inputRecipes, choices, input->id),
+                                                expectedInput, unexpandedBound);
+                if (branchItem && (!result || (branchItem == EXPLORE_LOOP)))
+                {
+                    result = branchItem;
+                }
+            }
+        }
+    }
+    worker->onPath[recipe->output.id] = 0;
+
+    return result;
+}
+
+internal f64
+score_explore_cost(Calculator *calculator, CostTest *cost, OptimizeObjective objective)
+{
+    f64 result = 0.0;
+    switch (objective)
+    {
+        case Objective_Resources:
+        {
+            for (u32 consumeIdx = 0; consumeIdx < cost->consumeCount; ++consumeIdx)
+            {
+                u32 itemId = cost->consumeOrder[consumeIdx];
+                if (get_recipes(calculator, itemId).count == 0)
+                {
+                    result += to_f64(cost->consumed[itemId]);
+                }
+            }
+        } break;
+
+        case Objective_Power:
+        {
+            for (u32 building = 1; building < calculator->buildingCount; ++building)
+            {
+                result += to_f64(cost->buildingCounts[building]) * calculator->buildings[building].power;
+            }
+        } break;
+
+        case Objective_Buildings:
+        {
+            for (u32 building = 1; building < calculator->buildingCount; ++building)
+            {
+                result += to_f64(cost->buildingCounts[building]);
+            }
+        } break;
+
+        INVALID_DEFAULT_CASE;
+    }
+    return result;
+}
+
+// NOTE(michiel): The part of the score of a partial plan that adding recipes can only make larger. Byproducts can
+// offset raw resources in the final netting, so only raw resources that are nobody's byproduct count.
+internal f64
+bound_explore_cost(ExplorePool *pool, CostTest *cost)
+{
+    f64 result = 0.0;
+    if (pool->objective == Objective_Resources)
+    {
+        for (u32 consumeIdx = 0; consumeIdx < cost->consumeCount; ++consumeIdx)
+        {
+            u32 itemId = cost->consumeOrder[consumeIdx];
+            if (pool->boundedItems[itemId])
+            {
+                result += to_f64(cost->consumed[itemId]);
+            }
+        }
+    }
+    else
+    {
+        result = score_explore_cost(pool->calculator, cost, pool->objective);
+    }
+    return result;
+}
+
+// NOTE(michiel): Relaxes bound[item] = min over its recipes of the own cost plus the bounds of the inputs, starting
+// from 0. Every pass is still a lower bound, so stopping early only makes the pruning weaker.
+internal void
+compute_explore_bounds(ExplorePool *pool)
+{
+    Calculator *calculator = pool->calculator;
+    pool->itemBounds = (f64 *)calloc(calculator->itemCount, sizeof(f64));
+    pool->boundedItems = (u8 *)calloc(calculator->itemCount, sizeof(u8));
+
+    if (pool->objective == Objective_Resources)
+    {
+        for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+        {
+            pool->boundedItems[itemId] = get_recipes(calculator, itemId).count == 0;
+        }
+        for (u32 recipeIdx = 0; recipeIdx < calculator->recipeCount; ++recipeIdx)
+        {
+            Recipe *recipe = calculator->recipes + recipeIdx;
+            for (u32 byproductIdx = 0; byproductIdx < recipe->byproductCount; ++byproductIdx)
+            {
+                pool->boundedItems[recipe->byproducts[byproductIdx].id] = false;
+            }
+        }
+        for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+        {
+            pool->itemBounds[itemId] = pool->boundedItems[itemId] ? 1.0 : 0.0;
+        }
+    }
+
+    b32 changed = true;
+    for (u32 pass = 0; changed && (pass < 64); ++pass)
+    {
+        changed = false;
+        for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+        {
+            RecipeList recipes = get_recipes(calculator, itemId);
+            f64 best = 0.0;
+            for (u32 recipeIdx = 0; recipeIdx < recipes.count; ++recipeIdx)
+            {
+                Recipe *recipe = recipes.recipes[recipeIdx];
+                f64 perItem = 1.0 / to_f64(recipe->output.itemsPerMinute);
+                f64 bound = 0.0;
+                if (pool->objective == Objective_Power) {
+                    bound = perItem * calculator->buildings[recipe->building].power;
+                } else if (pool->objective == Objective_Buildings) {
+                    bound = perItem;
+                }
+                for (u32 inputIdx = 0; inputIdx < recipe->inputCount; ++inputIdx)
+                {
+                    Item *input = recipe->inputs + inputIdx;
+                    bound += perItem * to_f64(input->itemsPerMinute) * pool->itemBounds[input->id];
+                }
+                if ((recipeIdx == 0) || (bound < best))
+                {
+                    best = bound;
+                }
+            }
+
+            if (recipes.count && (best > pool->itemBounds[itemId]))
+            {
+                pool->itemBounds[itemId] = best;
+                changed = true;
+            }
+        }
+    }
+}
+
+internal f64
+get_explore_bound(ExplorePool *pool)
+{
+    lock_explore_mutex(&pool->boundMutex);
+    f64 result = pool->bestBound;
+    unlock_explore_mutex(&pool->boundMutex);
+    return result;
+}
+
+// NOTE(michiel): Orders on score, equal scores on the choices, so the result does not depend on the thread count.
+internal b32
+explore_plan_before(u32 itemCount, ExplorePlan *a, ExplorePlan *b)
+{
+    b32 result = a->score < b->score;
+    if (a->score == b->score)
+    {
+        result = memcmp(a->choices, b->choices, sizeof(u16) * itemCount) < 0;
+    }
+    return result;
+}
+
+internal void
+add_explore_plan(ExploreWorker *worker, f64 score, u16 *choices)
+{
+    u32 itemCount = worker->pool->calculator->itemCount;
+    ExplorePlan plan = {score, choices};
+
+    u32 insertIdx = worker->planCount;
+    while (insertIdx && explore_plan_before(itemCount, &plan, worker->plans + insertIdx - 1))
+    {
+        --insertIdx;
+    }
+
+    if (insertIdx < worker->pool->maxPlanCount)
+    {
+        if (worker->planCount == worker->pool->maxPlanCount)
+        {
+            free(worker->plans[--worker->planCount].choices);
+        }
+        for (u32 planIdx = worker->planCount; planIdx > insertIdx; --planIdx)
+        {
+            worker->plans[planIdx] = worker->plans[planIdx - 1];
+        }
+        worker->plans[insertIdx] = plan;
+        ++worker->planCount;
+
+        // NOTE(michiel): The global worst kept plan is never worse than the local one, so this is a safe bound
+        if (worker->planCount == worker->pool->maxPlanCount)
+        {
+            ExplorePool *pool = worker->pool;
+            lock_explore_mutex(&pool->boundMutex);
+            if (worker->plans[worker->planCount - 1].score < pool->bestBound)
+            {
+                pool->bestBound = worker->plans[worker->planCount - 1].score;
+            }
+            unlock_explore_mutex(&pool->boundMutex);
+        }
+    }
+    else
+    {
+        free(choices);
+    }
+}
+
+internal void
+run_explore_task(ExploreWorker *worker, u16 *choices)
+{
+    ExplorePool *pool = worker->pool;
+    Calculator *calculator = pool->calculator;
+    ++worker->expandedCount;
+
+    u32 branchItem = 0;
+    f64 unexpandedBound = 0.0;
+    for (u32 targetIdx = 0; (branchItem != EXPLORE_LOOP) && (targetIdx < pool->targetCount); ++targetIdx)
+    {
+        ProductionTarget *target = pool->targets + targetIdx;
+        RecipeList recipes = get_recipes(calculator, target->itemId);
+        u32 targetBranch = 0;
+        if ((recipes.count > 1) && !choices[target->itemId])
+        {
+            targetBranch = target->itemId;
+            unexpandedBound += pool->itemBounds[target->itemId] * to_f64(target->itemsPerMinute);
+        }
+        else
+        {
+            targetBranch = explore_recipe(calculator, worker, choices, get_chosen_recipe(recipes, choices, target->itemId),
+                                          target->itemsPerMinute, &unexpandedBound);
+        }
+        if (targetBranch && (!branchItem || (targetBranch == EXPLORE_LOOP)))
+        {
+            branchItem = targetBranch;
+        }
+    }
+
+    if (branchItem && (branchItem != EXPLORE_LOOP) && pool->prune)
+    {
+        // NOTE(michiel): A little slack, the bound and the score add up the same rates in a different order
+        f64 bound = bound_explore_cost(pool, worker->cost) + unexpandedBound;
+        f64 bestBound = get_explore_bound(pool);
+        if (bound > bestBound + 1.0e-9 * (bestBound > 1.0 ? bestBound : 1.0))
+        {
+            ++worker->prunedCount;
+            branchItem = EXPLORE_LOOP;
+        }
+    }
+
+    if (branchItem == 0)
+    {
+        ++worker->completeCount;
+        output_input_cost(worker->cost);
+        add_explore_plan(worker, score_explore_cost(calculator, worker->cost, pool->objective), choices);
+    }
+    else
+    {
+        if (branchItem != EXPLORE_LOOP)
+        {
+            // NOTE(michiel): Pushed in reverse, so the default recipe is popped first and sets a bound early
+            RecipeList alternates = get_recipes(calculator, branchItem);
+            for (u32 alternateIdx = alternates.count - 1; alternateIdx < alternates.count; --alternateIdx)
+            {
+                u16 *childChoices = (u16 *)malloc(sizeof(u16) * calculator->itemCount);
+                memcpy(childChoices, choices, sizeof(u16) * calculator->itemCount);
+                childChoices[branchItem] = (u16)(alternateIdx + 1);
+                push_explore_task(worker, childChoices);
+            }
+        }
+        free(choices);
+    }
+    reset_cost(worker->cost);
+
+    explore_atomic_add(&pool->pendingCount, -1);
+}
+
+internal void
+run_explore_worker(ExploreWorker *worker)
+{
+    ExplorePool *pool = worker->pool;
+    for (;;)
+    {
+        u16 *choices = pop_explore_task(&worker->queue, false);
+        for (u32 offset = 1; !choices && (offset < pool->workerCount); ++offset)
+        {
+            choices = pop_explore_task(&pool->workers[(worker->index + offset) % pool->workerCount].queue, true);
+        }
+
+        if (choices)
+        {
+            run_explore_task(worker, choices);
+        }
+        else if (explore_atomic_add(&pool->pendingCount, 0) == 0)
+        {
+            break;
+        }
+        else
+        {
+            explore_yield();
+        }
+    }
+}
+
+#if _MSC_VER
+internal DWORD WINAPI
+explore_thread(LPVOID parameter)
+{
+    run_explore_worker((ExploreWorker *)parameter);
+    return 0;
+}
+#else
+internal void *
+explore_thread(void *parameter)
+{
+    run_explore_worker((ExploreWorker *)parameter);
+    return 0;
+}
+#endif
+
+internal void
+explore_recipes(Calculator *calculator, TextOutput output, CostTest *cost, u32 targetCount, ProductionTarget *targets,
+                OptimizeObjective objective, u32 planCount, u32 threadCount, b32 prune = true)
+{
+    ExplorePool pool = {};
+    pool.calculator = calculator;
+    pool.targetCount = targetCount;
+    pool.targets = targets;
+    pool.objective = objective;
+    pool.prune = prune;
+    pool.bestBound = HUGE_VAL;
+    init_explore_mutex(&pool.boundMutex);
+    compute_explore_bounds(&pool);
+    pool.maxPlanCount = (planCount && (planCount <= MAX_EXPLORE_PLANS)) ? planCount : MAX_EXPLORE_PLANS;
+    pool.workerCount = threadCount ? threadCount : get_processor_count();
+    if (pool.workerCount > MAX_EXPLORE_THREADS)
+    {
+        pool.workerCount = MAX_EXPLORE_THREADS;
+    }
+    pool.workers = (ExploreWorker *)calloc(pool.workerCount, sizeof(ExploreWorker));
+
+    for (u32 workerIdx = 0; workerIdx < pool.workerCount; ++workerIdx)
+    {
+        ExploreWorker *worker = pool.workers + workerIdx;
+        worker->pool = &pool;
+        worker->index = workerIdx;
+        init_explore_mutex(&worker->queue.mutex);
+        worker->cost = allocate_cost(calculator->itemCount);
+        worker->onPath = (u8 *)calloc(calculator->itemCount, sizeof(u8));
+    }
+
+    push_explore_task(pool.workers, (u16 *)calloc(calculator->itemCount, sizeof(u16)));
+
+    // NOTE(michiel): The calling thread is worker 0
+#if _MSC_VER
+    HANDLE threads[MAX_EXPLORE_THREADS];
+    for (u32 workerIdx = 1; workerIdx < pool.workerCount; ++workerIdx)
+    {
+        threads[workerIdx] = CreateThread(0, 0, explore_thread, pool.workers + workerIdx, 0, 0);
+    }
+    run_explore_worker(pool.workers);
+    for (u32 workerIdx = 1; workerIdx < pool.workerCount; ++workerIdx)
+    {
+        WaitForSingleObject(threads[workerIdx], INFINITE);
+        CloseHandle(threads[workerIdx]);
+    }
+#else
+    pthread_t threads[MAX_EXPLORE_THREADS];
+    for (u32 workerIdx = 1; workerIdx < pool.workerCount; ++workerIdx)
+    {
+        pthread_create(threads + workerIdx, 0, explore_thread, pool.workers + workerIdx);
+    }
+    run_explore_worker(pool.workers);
+    for (u32 workerIdx = 1; workerIdx < pool.workerCount; ++workerIdx)
+    {
+        pthread_join(threads[workerIdx], 0);
+    }
+#endif
+
+    // NOTE(michiel): Merge the best plans of all workers into worker 0
+    ExploreWorker *merged = pool.workers;
+    u64 expandedCount = merged->expandedCount;
+    u64 completeCount = merged->completeCount;
+    u64 prunedCount = merged->prunedCount;
+    for (u32 workerIdx = 1; workerIdx < pool.workerCount; ++workerIdx)
+    {
+        ExploreWorker *worker = pool.workers + workerIdx;
+        expandedCount += worker->expandedCount;
+        completeCount += worker->completeCount;
+        prunedCount += worker->prunedCount;
+        for (u32 planIdx = 0; planIdx < worker->planCount; ++planIdx)
+        {
+            add_explore_plan(merged, worker->plans[planIdx].score, worker->plans[planIdx].choices);
+        }
+        worker->planCount = 0;
+    }
+
+    const char *objectiveNames[] = {"raw resources", "power", "buildings"};
+    print_line(output, "Explored %llu combinations on %u threads (minimizing %s): %llu nodes expanded, %llu pruned",
+               (unsigned long long)completeCount, pool.workerCount, objectiveNames[objective],
+               (unsigned long long)expandedCount, (unsigned long long)prunedCount);
+    for (u32 planIdx = 0; planIdx < merged->planCount; ++planIdx)
+    {
+        ExplorePlan *plan = merged->plans + planIdx;
+        output_string(output.buffer, static_string("\n"));
+        print_line(output, "PLAN %u (score %.2f):", planIdx + 1, plan->score);
+        for (u32 targetIdx = 0; targetIdx < targetCount; ++targetIdx)
+        {
+            Recipe *recipe = get_chosen_recipe(get_recipes(calculator, targets[targetIdx].itemId), plan->choices,
+                                               targets[targetIdx].itemId);
+            print_recipe(calculator, output, cost, recipe, targets[targetIdx].itemsPerMinute, false, false, plan->choices);
+        }
+        output_string(output.buffer, static_string("\n"));
+        output_input_cost(cost);
+        print_cost(calculator, output, cost);
+        reset_cost(cost);
+    }
+
+    for (u32 workerIdx = 0; workerIdx < pool.workerCount; ++workerIdx)
+    {
+        ExploreWorker *worker = pool.workers + workerIdx;
+        for (u32 planIdx = 0; planIdx < worker->planCount; ++planIdx)
+        {
+            free(worker->plans[planIdx].choices);
+        }
+        free(worker->queue.tasks);
+        free_explore_mutex(&worker->queue.mutex);
+        free(worker->cost);
+        free(worker->onPath);
+    }
+    free(pool.workers);
+    free(pool.itemBounds);
+    free(pool.boundedItems);
+    free_explore_mutex(&pool.boundMutex);
+}
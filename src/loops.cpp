@@ -0,0 +1,355 @@
+// NOTE(michiel): The recipe graph, the picked recipe of every item with an edge to each input that has a recipe, split
+// into strongly connected components with Tarjan's algorithm. Most components are a single item, those are made in
+// topological order like before. A component with more than one item, or an item whose recipe takes in its own output,
+// is a loop (recycled rubber and plastic, or a recipe that needs some of what it makes to start).
+// A loop can not be walked, it runs at the steady state where every loop item is made as fast as it is used up. For
+// n loop items that is n linear equations, one per item, over the n multipliers of the loop recipes:
+//   sum over recipe k of (made - used of item i by recipe k at 1x) * x[k] = demand of item i from outside the loop
+// The inverse of that balance matrix is computed once, so the multipliers for any demand are a matrix product. A loop
+// that can only meet a demand with a negative multiplier uses up more than it makes, it is not productive.
+// The items of an unproductive loop, and every item whose picked recipes run into one, can not be made. That is only an
+// error for the queries that need them, the rest of the book works as usual.
+
+struct RecipeLoop
+{
+    u32 memberCount;
+    b32 productive;
+    u32 *items;
+    Recipe **recipes;
+    Rate *inverse;      // NOTE(michiel): memberCount x memberCount, the row is the recipe, the column the demanded item
+};
+
+struct RecipeLoops
+{
+    u32 itemCount;
+    u32 *loopSlots;     // NOTE(michiel): Per item, the loop index + 1, 0 if the item is not in a loop
+    u32 *memberSlots;   // NOTE(michiel): Per item, the index of the item in the members of its loop
+    u32 *blockSlots;    // NOTE(michiel): Per item, the index + 1 of the unproductive loop it runs into, 0 if it can be made
+
+    u32 loopCount;
+    RecipeLoop *loops;
+};
+
+internal Rate
+get_loop_ratio(RecipeLoop *loop, u32 memberIdx, u32 demandSlot)
+{
+    i_expect((memberIdx < loop->memberCount) && (demandSlot < loop->memberCount));
+    return loop->inverse[memberIdx * loop->memberCount + demandSlot];
+}
+
+internal RecipeLoop *
+get_item_loop(RecipeLoops *loops, u32 itemId)
+{
+    i_expect(itemId < loops->itemCount);
+    u32 loopSlot = loops->loopSlots[itemId];
+    return loopSlot ? loops->loops + loopSlot - 1 : 0;
+}
+
+// NOTE(michiel): The loop the recipe runs in, 0 if it is not part of one. Alternates of a loop item never are, the
+// loop is made of the picked recipes.
+internal RecipeLoop *
+get_recipe_loop(RecipeLoops *loops, Recipe *recipe)
+{
+    RecipeLoop *result = get_item_loop(loops, recipe->output.id);
+    if (result && (result->recipes[loops->memberSlots[recipe->output.id]] != recipe))
+    {
+        result = 0;
+    }
+    return result;
+}
+
+// NOTE(michiel): The unproductive loop the recipe runs into, 0 if everything it needs can be made. Only the picked
+// recipe of a loop item runs the loop, any other recipe just needs its inputs.
+internal RecipeLoop *
+get_blocking_loop(RecipeLoops *loops, Recipe *recipe)
+{
+    u32 blockSlot = 0;
+    if (get_recipe_loop(loops, recipe))
+    {
+        blockSlot = loops->blockSlots[recipe->output.id];
+    }
+    for (u32 inputIdx = 0; !blockSlot && (inputIdx < recipe->inputCount); ++inputIdx)
+    {
+        blockSlot = loops->blockSlots[recipe->inputs[inputIdx].id];
+    }
+    return blockSlot ? loops->loops + blockSlot - 1 : 0;
+}
+
+internal void
+print_blocking_loop(Calculator *calculator, TextOutput output, Recipe *recipe, RecipeLoop *loop)
+{
+    output_fmt(output.errors, "The recipes for '%.*s' run into a loop of", STR_FMT(recipe->output.name));
+    for (u32 memberIdx = 0; memberIdx < loop->memberCount; ++memberIdx)
+    {
+        output_fmt(output.errors, "%s '%.*s'", memberIdx ? "," : "", STR_FMT(calculator->itemNames[loop->items[memberIdx]]));
+    }
+    output_string(output.errors, static_string(" that uses up more than it makes\n"));
+}
+
+// NOTE(michiel): Gauss-Jordan on the balance matrix, the identity next to it turns into the inverse
+internal void
+invert_recipe_loop(RecipeLoops *loops, RecipeLoop *loop)
+{
+    u32 count = loop->memberCount;
+    u32 loopSlot = (u32)(loop - loops->loops) + 1;
+    Rate *balance = (Rate *)malloc(sizeof(Rate) * count * count);
+    for (u32 idx = 0; idx < count * count; ++idx)
+    {
+        balance[idx] = make_rate(0);
+        loop->inverse[idx] = make_rate(0);
+    }
+    for (u32 memberIdx = 0; memberIdx < count; ++memberIdx)
+    {
+        loop->inverse[memberIdx * count + memberIdx] = make_rate(1);
+
+        Recipe *recipe = loop->recipes[memberIdx];
+        balance[loops->memberSlots[recipe->output.id] * count + memberIdx] += recipe->output.itemsPerMinute;
+        for (u32 byproductIdx = 0; byproductIdx < recipe->byproductCount; ++byproductIdx)
+        {
+            Item *byproduct = recipe->byproducts + byproductIdx;
+            if (loops->loopSlots[byproduct->id] == loopSlot)
+            {
+                balance[loops->memberSlots[byproduct->id] * count + memberIdx] += byproduct->itemsPerMinute;
+            }
+        }
+        for (u32 inputIdx = 0; inputIdx < recipe->inputCount; ++inputIdx)
+        {
+            Item *input = recipe->inputs + inputIdx;
+            if (loops->loopSlots[input->id] == loopSlot)
+            {
+                balance[loops->memberSlots[input->id] * count + memberIdx] -= input->itemsPerMinute;
+            }
+        }
+    }
+
+    loop->productive = true;
+    for (u32 column = 0; loop->productive && (column < count); ++column)
+    {
+        u32 pivotRow = column;
+        for (u32 row = column + 1; row < count; ++row)
+        {
+            if (fabs(to_f64(balance[row * count + column])) > fabs(to_f64(balance[pivotRow * count + column])))
+            {
+                pivotRow = row;
+            }
+        }
+
+        Rate pivot = balance[pivotRow * count + column];
+        if (is_zero(pivot) || (fabs(to_f64(pivot)) < 1.0e-12))
+        {
+            // NOTE(michiel): The loop makes exactly what it uses of some mix of its items, no demand can be met
+            loop->productive = false;
+        }
+        else
+        {
+            for (u32 idx = 0; idx < count; ++idx)
+            {
+                Rate temp = balance[pivotRow * count + idx];
+                balance[pivotRow * count + idx] = balance[column * count + idx];
+                balance[column * count + idx] = temp / pivot;
+                temp = loop->inverse[pivotRow * count + idx];
+                loop->inverse[pivotRow * count + idx] = loop->inverse[column * count + idx];
+                loop->inverse[column * count + idx] = temp / pivot;
+            }
+
+            for (u32 row = 0; row < count; ++row)
+            {
+                Rate factor = balance[row * count + column];
+                if ((row != column) && !is_zero(factor))
+                {
+                    for (u32 idx = 0; idx < count; ++idx)
+                    {
+                        balance[row * count + idx] -= factor * balance[column * count + idx];
+                        loop->inverse[row * count + idx] -= factor * loop->inverse[column * count + idx];
+                    }
+                }
+            }
+        }
+    }
+
+    for (u32 idx = 0; loop->productive && (idx < count * count); ++idx)
+    {
+        if (to_f64(loop->inverse[idx]) < -1.0e-9)
+        {
+            loop->productive = false;
+        }
+    }
+    free(balance);
+}
+
+internal void
+add_recipe_loop(Calculator *calculator, u16 *choices, RecipeLoops *loops, u32 memberCount, u32 *members)
+{
+    RecipeLoop *loop = loops->loops + loops->loopCount++;
+    umm rateSize = sizeof(Rate) * memberCount * memberCount;
+    umm recipeSize = sizeof(Recipe *) * memberCount;
+    u8 *memory = (u8 *)malloc(rateSize + recipeSize + sizeof(u32) * memberCount);
+    loop->memberCount = memberCount;
+    loop->inverse = (Rate *)memory;
+    loop->recipes = (Recipe **)(memory + rateSize);
+    loop->items = (u32 *)(memory + rateSize + recipeSize);
+
+    for (u32 memberIdx = 0; memberIdx < memberCount; ++memberIdx)
+    {
+        u32 itemId = members[memberIdx];
+        loop->items[memberIdx] = itemId;
+        loop->recipes[memberIdx] = get_chosen_recipe(get_recipes(calculator, itemId), choices, itemId);
+        loops->loopSlots[itemId] = loops->loopCount;
+        loops->memberSlots[itemId] = memberIdx;
+    }
+    invert_recipe_loop(loops, loop);
+}
+
+// NOTE(michiel): choices holds the picked recipe index + 1 per item, 0 (or no choices at all) is the default recipe
+internal RecipeLoops *
+find_recipe_loops(Calculator *calculator, u16 *choices)
+{
+    u32 itemCount = calculator->itemCount;
+    RecipeLoops *result = (RecipeLoops *)calloc(1, sizeof(RecipeLoops));
+    result->itemCount = itemCount;
+    result->loopSlots = (u32 *)calloc(itemCount, sizeof(u32));
+    result->memberSlots = (u32 *)calloc(itemCount, sizeof(u32));
+    result->blockSlots = (u32 *)calloc(itemCount, sizeof(u32));
+    result->loops = (RecipeLoop *)calloc(itemCount ? itemCount : 1, sizeof(RecipeLoop));
+
+    // NOTE(michiel): Without recursion, long chains of recipes would run out of stack. The call stack holds the item
+    // and the next input to look at, indices are the visit order + 1 (0 is not visited yet).
+    u32 *indices = (u32 *)calloc(itemCount, sizeof(u32));
+    u32 *lowLinks = (u32 *)calloc(itemCount, sizeof(u32));
+    u8 *onStack = (u8 *)calloc(itemCount, sizeof(u8));
+    u32 *stack = (u32 *)malloc(sizeof(u32) * itemCount);
+    u32 *callItems = (u32 *)malloc(sizeof(u32) * itemCount);
+    u32 *callInputs = (u32 *)malloc(sizeof(u32) * itemCount);
+
+    u32 nextIndex = 1;
+    u32 stackCount = 0;
+    for (u32 rootId = 1; rootId < itemCount; ++rootId)
+    {
+        if (indices[rootId] || !get_recipes(calculator, rootId).count)
+        {
+            continue;
+        }
+
+        u32 callCount = 0;
+        indices[rootId] = lowLinks[rootId] = nextIndex++;
+        stack[stackCount++] = rootId;
+        onStack[rootId] = true;
+        callItems[callCount] = rootId;
+        callInputs[callCount++] = 0;
+
+        while (callCount)
+        {
+            u32 itemId = callItems[callCount - 1];
+            Recipe *recipe = get_chosen_recipe(get_recipes(calculator, itemId), choices, itemId);
+            if (callInputs[callCount - 1] < recipe->inputCount)
+            {
+                u32 inputId = recipe->inputs[callInputs[callCount - 1]++].id;
+                if (!get_recipes(calculator, inputId).count)
+                {
+                    // NOTE(michiel): Raw resources are not part of the graph
+                }
+                else if (!indices[inputId])
+                {
+                    indices[inputId] = lowLinks[inputId] = nextIndex++;
+                    stack[stackCount++] = inputId;
+                    onStack[inputId] = true;
+                    callItems[callCount] = inputId;
+                    callInputs[callCount++] = 0;
+                }
+                else if (onStack[inputId] && (indices[inputId] < lowLinks[itemId]))
+                {
+                    lowLinks[itemId] = indices[inputId];
+                }
+            }
+            else
+            {
+                --callCount;
+                if (callCount && (lowLinks[itemId] < lowLinks[callItems[callCount - 1]]))
+                {
+                    lowLinks[callItems[callCount - 1]] = lowLinks[itemId];
+                }
+
+                if (lowLinks[itemId] == indices[itemId])
+                {
+                    u32 firstMember = stackCount - 1;
+                    while (stack[firstMember] != itemId)
+                    {
+                        --firstMember;
+                    }
+                    u32 memberCount = stackCount - firstMember;
+
+                    b32 isLoop = memberCount > 1;
+                    for (u32 inputIdx = 0; !isLoop && (inputIdx < recipe->inputCount); ++inputIdx)
+                    {
+                        isLoop = recipe->inputs[inputIdx].id == itemId;
+                    }
+                    u32 blockSlot = 0;
+                    if (isLoop)
+                    {
+                        add_recipe_loop(calculator, choices, result, memberCount, stack + firstMember);
+                        if (!result->loops[result->loopCount - 1].productive)
+                        {
+                            blockSlot = result->loopCount;
+                        }
+                    }
+
+                    // NOTE(michiel): The components come out inputs first, so the inputs from outside of this one
+                    // already know if they can be made
+                    for (u32 memberIdx = firstMember; !blockSlot && (memberIdx < stackCount); ++memberIdx)
+                    {
+                        u32 memberId = stack[memberIdx];
+                        Recipe *member = get_chosen_recipe(get_recipes(calculator, memberId), choices, memberId);
+                        for (u32 inputIdx = 0; !blockSlot && (inputIdx < member->inputCount); ++inputIdx)
+                        {
+                            blockSlot = result->blockSlots[member->inputs[inputIdx].id];
+                        }
+                    }
+
+                    for (u32 memberIdx = firstMember; memberIdx < stackCount; ++memberIdx)
+                    {
+                        onStack[stack[memberIdx]] = false;
+                        result->blockSlots[stack[memberIdx]] = blockSlot;
+                    }
+                    stackCount = firstMember;
+                }
+            }
+        }
+    }
+
+    free(indices);
+    free(lowLinks);
+    free(onStack);
+    free(stack);
+    free(callItems);
+    free(callInputs);
+
+    return result;
+}
+
+internal void
+free_recipe_loops(RecipeLoops *loops)
+{
+    if (loops)
+    {
+        for (u32 loopIdx = 0; loopIdx < loops->loopCount; ++loopIdx)
+        {
+            free(loops->loops[loopIdx].inverse);
+        }
+        free(loops->loopSlots);
+        free(loops->memberSlots);
+        free(loops->blockSlots);
+        free(loops->loops);
+        free(loops);
+    }
+}
+
+// NOTE(michiel): The loops of the default recipes, found on first use
+internal RecipeLoops *
+get_recipe_loops(Calculator *calculator)
+{
+    if (!calculator->recipeLoops)
+    {
+        calculator->recipeLoops = find_recipe_loops(calculator, 0);
+    }
+    return calculator->recipeLoops;
+}
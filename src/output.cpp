@@ -0,0 +1,196 @@
+// NOTE(michiel): Per query memory and output. Plans are built in a linear arena that gets reset after every query,
+// all text goes into one growable buffer that is written out with a single fwrite when the query is done.
+
+#include <stdarg.h>
+
+struct QueryArenaBlock
+{
+    QueryArenaBlock *prev;
+    umm size;
+    umm used;
+};
+
+struct QueryArena
+{
+    QueryArenaBlock *current;
+    umm minimumBlockSize;
+};
+
+#define arena_push_struct(arena, type)        (type *)arena_push(arena, sizeof(type))
+#define arena_push_array(arena, count, type)  (type *)arena_push(arena, sizeof(type) * (count))
+
+// NOTE(michiel): Returns zeroed memory, aligned to 16 bytes
+internal void *
+arena_push(QueryArena *arena, umm size)
+{
+    size = (size + 15) & ~(umm)15;
+    QueryArenaBlock *block = arena->current;
+    if (!block || (block->used + size > block->size))
+    {
+        umm blockSize = arena->minimumBlockSize ? arena->minimumBlockSize : 64 * 1024;
+        if (blockSize < size)
+        {
+            blockSize = size;
+        }
+        block = (QueryArenaBlock *)malloc(sizeof(QueryArenaBlock) + 16 + blockSize);
+        block->prev = arena->current;
+        block->size = blockSize;
+        block->used = 0;
+        arena->current = block;
+    }
+
+    u8 *base = (u8 *)(((umm)(block + 1) + 15) & ~(umm)15);
+    void *result = base + block->used;
+    block->used += size;
+    memset(result, 0, size);
+    return result;
+}
+
+// NOTE(michiel): Keeps a single block that fits everything the last query used, so the next one does not allocate
+internal void
+reset_arena(QueryArena *arena)
+{
+    QueryArenaBlock *block = arena->current;
+    if (block && block->prev)
+    {
+        umm totalSize = 0;
+        while (block)
+        {
+            QueryArenaBlock *prev = block->prev;
+            totalSize += block->size;
+            free(block);
+            block = prev;
+        }
+        arena->current = 0;
+        arena->minimumBlockSize = totalSize;
+    }
+    else if (block)
+    {
+        block->used = 0;
+    }
+}
+
+internal void
+free_arena(QueryArena *arena)
+{
+    while (arena->current)
+    {
+        QueryArenaBlock *prev = arena->current->prev;
+        free(arena->current);
+        arena->current = prev;
+    }
+}
+
+struct OutputBuffer
+{
+    umm size;
+    umm maxSize;
+    u8 *data;
+};
+
+internal void
+reserve_output(OutputBuffer *buffer, umm extraSize)
+{
+    if (buffer->size + extraSize > buffer->maxSize)
+    {
+        umm newMaxSize = buffer->maxSize ? 2 * buffer->maxSize : 64 * 1024;
+        while (newMaxSize < buffer->size + extraSize)
+        {
+            newMaxSize *= 2;
+        }
+        buffer->data = (u8 *)realloc(buffer->data, newMaxSize);
+        buffer->maxSize = newMaxSize;
+    }
+}
+
+internal void
+output_vfmt(OutputBuffer *buffer, const char *fmt, va_list args)
+{
+    va_list retryArgs;
+    va_copy(retryArgs, args);
+    reserve_output(buffer, 256);
+    umm available = buffer->maxSize - buffer->size;
+    s32 written = vsnprintf((char *)buffer->data + buffer->size, available, fmt, args);
+    if ((written > 0) && ((umm)written >= available))
+    {
+        reserve_output(buffer, (umm)written + 1);
+        written = vsnprintf((char *)buffer->data + buffer->size, buffer->maxSize - buffer->size, fmt, retryArgs);
+    }
+    va_end(retryArgs);
+    if (written > 0)
+    {
+        buffer->size += written;
+    }
+}
+
+internal void
+output_fmt(OutputBuffer *buffer, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    output_vfmt(buffer, fmt, args);
+    va_end(args);
+}
+
+internal void
+output_string(OutputBuffer *buffer, String text)
+{
+    reserve_output(buffer, text.size);
+    memcpy(buffer->data + buffer->size, text.data, text.size);
+    buffer->size += text.size;
+}
+
+internal void
+output_spaces(OutputBuffer *buffer, u32 count)
+{
+    reserve_output(buffer, count);
+    memset(buffer->data + buffer->size, ' ', count);
+    buffer->size += count;
+}
+
+internal void
+flush_output(OutputBuffer *buffer, FILE *file)
+{
+    if (buffer->size)
+    {
+        fwrite(buffer->data, 1, buffer->size, file);
+        fflush(file);
+        buffer->size = 0;
+    }
+}
+
+// NOTE(michiel): Passed by value, like a stream, so every recursion level has its own indent
+struct TextOutput
+{
+    OutputBuffer *buffer;
+    OutputBuffer *errors;
+    QueryArena *arena;
+    u32 indent;
+    u32 beltTier;   // NOTE(michiel): 1 to 5 splits flows over that conveyor belt mark into parallel belts, 0 is off
+};
+
+internal void
+print_line(TextOutput output, const char *fmt, ...)
+{
+    output_spaces(output.buffer, output.indent * 2);
+
+    va_list args;
+    va_start(args, fmt);
+    output_vfmt(output.buffer, fmt, args);
+    va_end(args);
+
+    output_string(output.buffer, static_string("\n"));
+}
+
+// NOTE(michiel): Errors are kept apart from the output, the command line writes them to stderr and the server sends them
+// back in place of the result
+internal void
+print_error(TextOutput output, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    output_vfmt(output.errors, fmt, args);
+    va_end(args);
+
+    output_string(output.errors, static_string("\n"));
+}
@@ -0,0 +1,340 @@
+// NOTE(michiel): Rates are exact fractions of 64 bit integers, with a double alongside. If an operation would overflow
+// (or exact rates are turned off with -F) the fraction is dropped by setting the denominator to 0 and the double carries
+// the value from there on. Exact rates make 100/3 + 200/3 - 100 come out as 0, so netting does not leave residues.
+
+global b32 gExactRates = true;
+
+struct Rate
+{
+    s64 numerator;
+    s64 denominator; // NOTE(michiel): > 0 for an exact rate, 0 for an approximate one
+    f64 value;
+};
+
+internal b32
+is_exact(Rate rate)
+{
+    return rate.denominator != 0;
+}
+
+internal f64
+to_f64(Rate rate)
+{
+    return rate.value;
+}
+
+internal u64
+gcd_u64(u64 a, u64 b)
+{
+    // NOTE(michiel): Binary gcd, trailing zero counts instead of divisions
+    u64 result = a | b;
+    if (a && b)
+    {
+#if _MSC_VER
+        unsigned long shift;
+        _BitScanForward64(&shift, a | b);
+        unsigned long zeros;
+        _BitScanForward64(&zeros, a);
+        a >>= zeros;
+        do
+        {
+            _BitScanForward64(&zeros, b);
+            b >>= zeros;
+            if (a > b)
+            {
+                u64 temp = a;
+                a = b;
+                b = temp;
+            }
+            b -= a;
+        } while (b);
+#else
+        u32 shift = __builtin_ctzll(a | b);
+        a >>= __builtin_ctzll(a);
+        do
+        {
+            b >>= __builtin_ctzll(b);
+            if (a > b)
+            {
+                u64 temp = a;
+                a = b;
+                b = temp;
+            }
+            b -= a;
+        } while (b);
+#endif
+        result = a << shift;
+    }
+    return result;
+}
+
+internal b32
+multiply_s64(s64 a, s64 b, s64 *result)
+{
+#if _MSC_VER
+    s64 high;
+    *result = _mul128(a, b, &high);
+    return high == (*result >> 63);
+#else
+    return !__builtin_mul_overflow(a, b, result);
+#endif
+}
+
+internal b32
+add_s64(s64 a, s64 b, s64 *result)
+{
+#if _MSC_VER
+    *result = (s64)((u64)a + (u64)b);
+    return !(((a ^ *result) & (b ^ *result)) < 0);
+#else
+    return !__builtin_add_overflow(a, b, result);
+#endif
+}
+
+internal Rate
+approximate_rate(f64 value)
+{
+    Rate result = {};
+    result.value = value;
+    return result;
+}
+
+// NOTE(michiel): Normalizes the sign and reduces the fraction, the denominator must not be 0.
+internal Rate
+make_rate(s64 numerator, s64 denominator = 1)
+{
+    i_expect(denominator);
+    Rate result = {};
+    if (denominator < 0)
+    {
+        numerator = -numerator;
+        denominator = -denominator;
+    }
+    u64 divisor = gcd_u64(numerator < 0 ? -(u64)numerator : (u64)numerator, (u64)denominator);
+    result.numerator = numerator / (s64)divisor;
+    result.denominator = denominator / (s64)divisor;
+    result.value = (f64)result.numerator / (f64)result.denominator;
+    if (!gExactRates)
+    {
+        result.denominator = 0;
+    }
+    return result;
+}
+
+// NOTE(michiel): Parses a plain decimal number like 2.8125 into the exact fraction 45/16.
+internal b32
+parse_rate_number(String text, Rate *rate)
+{
+    s64 numerator = 0;
+    s64 denominator = 1;
+    b32 seenDot = false;
+    b32 result = text.size != 0;
+    for (u32 idx = 0; result && (idx < text.size); ++idx)
+    {
+        u8 c = text.data[idx];
+        if ((c == '.') && !seenDot)
+        {
+            seenDot = true;
+        }
+        else if ((c >= '0') && (c <= '9'))
+        {
+            result = multiply_s64(numerator, 10, &numerator) && add_s64(numerator, c - '0', &numerator);
+            if (seenDot)
+            {
+                result = result && multiply_s64(denominator, 10, &denominator);
+            }
+        }
+        else
+        {
+            result = false;
+        }
+    }
+
+    if (result)
+    {
+        *rate = make_rate(numerator, denominator);
+    }
+    return result;
+}
+
+// NOTE(michiel): Finds the closest fraction with a bounded denominator using continued fractions, for values that
+// come out of floating point code (the simplex) but are fractions of the recipe rates.
+internal Rate
+rate_from_f64(f64 value, s64 maxDenominator = 1000000)
+{
+    Rate result = approximate_rate(value);
+    if (gExactRates && (value < 9.0e15) && (value > -9.0e15))
+    {
+        f64 remainder = value < 0.0 ? -value : value;
+        s64 prevNumerator = 0, numerator = 1;
+        s64 prevDenominator = 1, denominator = 0;
+        for (u32 iteration = 0; iteration < 64; ++iteration)
+        {
+            f64 whole = floor(remainder);
+            s64 term = (s64)whole;
+            s64 nextNumerator, nextDenominator;
+            if (!multiply_s64(term, numerator, &nextNumerator) || !add_s64(nextNumerator, prevNumerator, &nextNumerator) ||
+                !multiply_s64(term, denominator, &nextDenominator) || !add_s64(nextDenominator, prevDenominator, &nextDenominator) ||
+                (nextDenominator > maxDenominator))
+            {
+                break;
+            }
+            prevNumerator = numerator;
+            numerator = nextNumerator;
+            prevDenominator = denominator;
+            denominator = nextDenominator;
+
+            f64 fraction = remainder - whole;
+            f64 error = (f64)numerator / (f64)denominator - (value < 0.0 ? -value : value);
+            if ((fraction < 1.0e-12) || ((error < 1.0e-9) && (error > -1.0e-9)))
+            {
+                break;
+            }
+            remainder = 1.0 / fraction;
+        }
+
+        if (denominator)
+        {
+            f64 error = (f64)numerator / (f64)denominator - (value < 0.0 ? -value : value);
+            if ((error < 1.0e-7) && (error > -1.0e-7))
+            {
+                result = make_rate(value < 0.0 ? -numerator : numerator, denominator);
+            }
+        }
+    }
+    return result;
+}
+
+internal Rate
+operator+(Rate a, Rate b)
+{
+    Rate result = approximate_rate(a.value + b.value);
+    if (is_exact(a) && is_exact(b))
+    {
+        s64 divisor = (s64)gcd_u64((u64)a.denominator, (u64)b.denominator);
+        s64 left, right, numerator, denominator;
+        if (multiply_s64(a.numerator, b.denominator / divisor, &left) &&
+            multiply_s64(b.numerator, a.denominator / divisor, &right) &&
+            add_s64(left, right, &numerator) &&
+            multiply_s64(a.denominator / divisor, b.denominator, &denominator))
+        {
+            result = make_rate(numerator, denominator);
+        }
+    }
+    return result;
+}
+
+internal Rate
+operator-(Rate a)
+{
+    Rate result = a;
+    result.numerator = -a.numerator;
+    result.value = -a.value;
+    return result;
+}
+
+internal Rate
+operator-(Rate a, Rate b)
+{
+    return a + (-b);
+}
+
+internal Rate
+operator*(Rate a, Rate b)
+{
+    Rate result = approximate_rate(a.value * b.value);
+    if (is_exact(a) && is_exact(b))
+    {
+        // NOTE(michiel): Cross reduce first, keeps the intermediates small
+        s64 divisorAD = (s64)gcd_u64(a.numerator < 0 ? -(u64)a.numerator : (u64)a.numerator, (u64)b.denominator);
+        s64 divisorBC = (s64)gcd_u64(b.numerator < 0 ? -(u64)b.numerator : (u64)b.numerator, (u64)a.denominator);
+        if (!divisorAD) { divisorAD = 1; }
+        if (!divisorBC) { divisorBC = 1; }
+        s64 numerator, denominator;
+        if (multiply_s64(a.numerator / divisorAD, b.numerator / divisorBC, &numerator) &&
+            multiply_s64(a.denominator / divisorBC, b.denominator / divisorAD, &denominator))
+        {
+            result = make_rate(numerator, denominator);
+        }
+    }
+    return result;
+}
+
+internal Rate
+operator/(Rate a, Rate b)
+{
+    Rate result = approximate_rate(a.value / b.value);
+    if (is_exact(a) && is_exact(b) && b.numerator)
+    {
+        Rate inverse = b;
+        inverse.numerator = b.denominator;
+        inverse.denominator = b.numerator;
+        if (inverse.denominator < 0)
+        {
+            inverse.numerator = -inverse.numerator;
+            inverse.denominator = -inverse.denominator;
+        }
+        inverse.value = 1.0 / b.value;
+        result = a * inverse;
+    }
+    return result;
+}
+
+internal Rate &
+operator+=(Rate &a, Rate b)
+{
+    a = a + b;
+    return a;
+}
+
+internal Rate &
+operator-=(Rate &a, Rate b)
+{
+    a = a - b;
+    return a;
+}
+
+// NOTE(michiel): Returns -1, 0 or 1. Exact rates compare exactly, there are no epsilons anywhere.
+internal s32
+compare_rates(Rate a, Rate b)
+{
+    s32 result = (a.value < b.value) ? -1 : ((a.value > b.value) ? 1 : 0);
+    if (is_exact(a) && is_exact(b))
+    {
+        s64 left, right;
+        if (multiply_s64(a.numerator, b.denominator, &left) && multiply_s64(b.numerator, a.denominator, &right))
+        {
+            result = (left < right) ? -1 : ((left > right) ? 1 : 0);
+        }
+    }
+    return result;
+}
+
+internal b32 operator< (Rate a, Rate b) { return compare_rates(a, b) <  0; }
+internal b32 operator> (Rate a, Rate b) { return compare_rates(a, b) >  0; }
+internal b32 operator<=(Rate a, Rate b) { return compare_rates(a, b) <= 0; }
+internal b32 operator>=(Rate a, Rate b) { return compare_rates(a, b) >= 0; }
+internal b32 operator==(Rate a, Rate b) { return compare_rates(a, b) == 0; }
+internal b32 operator!=(Rate a, Rate b) { return compare_rates(a, b) != 0; }
+
+internal b32
+is_zero(Rate rate)
+{
+    return is_exact(rate) ? (rate.numerator == 0) : (rate.value == 0.0);
+}
+
+internal Rate
+rate_ceil(Rate rate)
+{
+    Rate result = approximate_rate(ceil(rate.value));
+    if (is_exact(rate))
+    {
+        s64 whole = rate.numerator / rate.denominator;
+        if ((rate.numerator > 0) && (whole * rate.denominator != rate.numerator))
+        {
+            ++whole;
+        }
+        result = make_rate(whole);
+    }
+    return result;
+}
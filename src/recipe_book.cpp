@@ -0,0 +1,959 @@
+// NOTE(michiel): Loading the recipe book, either from the text format in data/recipes.txt or from a binary snapshot
+// written by write_snapshot. The snapshot is memory mapped and used mostly in place, only the recipes and the
+// producer pointers get rebuilt.
+// build.sh also writes the default book as a header with write_builtin_book and compiles it in, with
+// SATISFACTORY_CALC_BUILTIN_BOOK. All tables are static and initialized by the compiler, including a perfect hash for
+// the item names, so load_builtin_book only points the calculator at them.
+
+#if _MSC_VER
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SNAPSHOT_MAGIC   0x42524353 // NOTE(michiel): "SCRB"
+#define SNAPSHOT_VERSION 3
+
+struct SnapshotString
+{
+    u32 offset;
+    u32 size;
+};
+
+struct SnapshotBuilding
+{
+    SnapshotString name;
+    SnapshotString plural;
+    f32 power;
+};
+
+struct SnapshotItem
+{
+    u32 id;
+    u32 reserved;
+    Rate itemsPerMinute;
+};
+
+// NOTE(michiel): The byproducts and inputs are a run in the recipe items, the same as Recipe
+struct SnapshotRecipe
+{
+    u32 building;
+    u32 firstItem;
+    u32 byproductCount;
+    u32 inputCount;
+    SnapshotItem output;
+};
+
+// NOTE(michiel): Followed by the buildings, item names, item map, item recipe ranges, recipes, recipe items, producer
+// indices and finally the string bytes. Every section starts 8 byte aligned.
+struct SnapshotHeader
+{
+    u32 magic;
+    u32 version;
+    u32 buildingCount;
+    u32 itemCount;
+    u32 itemMapMask;
+    u32 recipeCount;
+    u32 recipeItemCount;
+    u32 stringSize;
+
+    u32 buildingOffset;
+    u32 itemNameOffset;
+    u32 itemMapOffset;
+    u32 itemRecipeOffset;
+    u32 recipeOffset;
+    u32 recipeItemOffset;
+    u32 producerOffset;
+    u32 stringOffset;
+};
+
+internal String
+trim_spaces(String text)
+{
+    while (text.size && ((text.data[0] == ' ') || (text.data[0] == '\t')))
+    {
+        ++text.data;
+        --text.size;
+    }
+    while (text.size && ((text.data[text.size - 1] == ' ') || (text.data[text.size - 1] == '\t') ||
+                         (text.data[text.size - 1] == '\r')))
+    {
+        --text.size;
+    }
+    return text;
+}
+
+// NOTE(michiel): Returns the part before the separator and advances text past it, or the whole text if the
+// separator is not found.
+internal String
+split_off(String *text, String separator)
+{
+    String result = *text;
+    text->size = 0;
+    for (u32 idx = 0; idx + separator.size <= result.size; ++idx)
+    {
+        String test = {separator.size, result.data + idx};
+        if (test == separator)
+        {
+            text->data = result.data + idx + separator.size;
+            text->size = result.size - idx - separator.size;
+            result.size = idx;
+            break;
+        }
+    }
+    return result;
+}
+
+// NOTE(michiel): The number of entries in a comma separated list, 0 for an empty one
+internal u32
+count_list_entries(String list)
+{
+    u32 result = list.size ? 1 : 0;
+    for (u32 idx = 0; idx < list.size; ++idx)
+    {
+        if (list.data[idx] == ',')
+        {
+            ++result;
+        }
+    }
+    return result;
+}
+
+internal b32
+parse_rate(String text, Rate *itemsPerMinute, String *name)
+{
+    u32 numberSize = 0;
+    while ((numberSize < text.size) &&
+           (((text.data[numberSize] >= '0') && (text.data[numberSize] <= '9')) || (text.data[numberSize] == '.')))
+    {
+        ++numberSize;
+    }
+
+    String number = {numberSize, text.data};
+    String rest = {text.size - numberSize, text.data + numberSize};
+    *name = trim_spaces(rest);
+
+    b32 result = numberSize && (numberSize < text.size) && (rest.data[0] == ' ') && name->size;
+    if (result)
+    {
+        result = parse_rate_number(number, itemsPerMinute) && !is_zero(*itemsPerMinute);
+    }
+    return result;
+}
+
+internal b32
+parse_recipe_book(Calculator *calculator, String filename, String text)
+{
+    b32 result = true;
+    u32 lineNumber = 0;
+
+    while (text.size && result)
+    {
+        String line = split_off(&text, static_string("\n"));
+        ++lineNumber;
+
+        String comment = line;
+        line = trim_spaces(split_off(&comment, static_string("#")));
+        if (line.size == 0)
+        {
+            continue;
+        }
+
+        const char *error = 0;
+        String buildingStart = {9, line.data};
+        if ((line.size > 9) && (buildingStart == static_string("building ")))
+        {
+            String rest = {line.size - 9, line.data + 9};
+            String name = trim_spaces(split_off(&rest, static_string(",")));
+            String plural = trim_spaces(split_off(&rest, static_string(",")));
+            String power = trim_spaces(rest);
+            if (name.size && plural.size && power.size)
+            {
+                if (find_building(calculator, name)) {
+                    error = "duplicate building";
+                } else if (calculator->buildingCount + 1 >= MAX_BUILDING_COUNT) {
+                    error = "too many buildings";
+                } else {
+                    add_building(calculator, name, plural, (f32)float_from_string(power));
+                }
+            }
+            else
+            {
+                error = "expected 'building <name>, <plural>, <power>'";
+            }
+        }
+        else
+        {
+            String rest = line;
+            String buildingName = trim_spaces(split_off(&rest, static_string(":")));
+            String outputs = trim_spaces(split_off(&rest, static_string("<-")));
+            String inputs = trim_spaces(rest);
+
+            u32 building = find_building(calculator, buildingName);
+            if (!building)
+            {
+                error = "unknown building";
+            }
+            else if (!outputs.size || !inputs.size)
+            {
+                error = "expected '<building>: <outputs> <- <inputs>'";
+            }
+            else
+            {
+                Rate rate;
+                String name;
+                if (parse_rate(trim_spaces(split_off(&outputs, static_string(","))), &rate, &name))
+                {
+                    // NOTE(michiel): Any outputs after the first one are byproducts
+                    Recipe *recipe = add_recipe(calculator, building, name, rate, count_list_entries(outputs),
+                                                count_list_entries(inputs));
+                    for (u32 byproductIdx = 0; !error && (byproductIdx < recipe->byproductCount); ++byproductIdx)
+                    {
+                        if (parse_rate(trim_spaces(split_off(&outputs, static_string(","))), &rate, &name)) {
+                            set_item(calculator, recipe->byproducts + byproductIdx, name, rate);
+                        } else {
+                            error = "expected '<rate> <byproduct>'";
+                        }
+                    }
+
+                    for (u32 inputIdx = 0; !error && (inputIdx < recipe->inputCount); ++inputIdx)
+                    {
+                        if (parse_rate(trim_spaces(split_off(&inputs, static_string(","))), &rate, &name)) {
+                            set_item(calculator, recipe->inputs + inputIdx, name, rate);
+                        } else {
+                            error = "expected '<rate> <input>'";
+                        }
+                    }
+                }
+                else
+                {
+                    error = "expected '<rate> <output>'";
+                }
+            }
+        }
+
+        if (error)
+        {
+            fprintf(stderr, "%.*s:%u: %s\n", STR_FMT(filename), lineNumber, error);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+internal u32
+snapshot_align(u32 offset)
+{
+    return (offset + 7) & ~7;
+}
+
+internal b32
+write_snapshot(Calculator *calculator, const char *filename)
+{
+    SnapshotHeader header = {};
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.buildingCount = calculator->buildingCount;
+    header.itemCount = calculator->itemCount;
+    header.itemMapMask = calculator->itemMapMask;
+    header.recipeCount = calculator->recipeCount;
+    header.recipeItemCount = calculator->recipeItemCount;
+
+    header.stringSize = 0;
+    for (u32 building = 0; building < calculator->buildingCount; ++building)
+    {
+        header.stringSize += calculator->buildings[building].name.size + calculator->buildings[building].plural.size;
+    }
+    for (u32 itemId = 0; itemId < calculator->itemCount; ++itemId)
+    {
+        header.stringSize += calculator->itemNames[itemId].size;
+    }
+
+    u32 offset = snapshot_align(sizeof(SnapshotHeader));
+    header.buildingOffset = offset;
+    offset = snapshot_align(offset + sizeof(SnapshotBuilding) * header.buildingCount);
+    header.itemNameOffset = offset;
+    offset = snapshot_align(offset + sizeof(SnapshotString) * header.itemCount);
+    header.itemMapOffset = offset;
+    offset = snapshot_align(offset + sizeof(u32) * (header.itemMapMask + 1));
+    header.itemRecipeOffset = offset;
+    offset = snapshot_align(offset + sizeof(RecipeRange) * header.itemCount);
+    header.recipeOffset = offset;
+    offset = snapshot_align(offset + sizeof(SnapshotRecipe) * header.recipeCount);
+    header.recipeItemOffset = offset;
+    offset = snapshot_align(offset + sizeof(SnapshotItem) * header.recipeItemCount);
+    header.producerOffset = offset;
+    offset = snapshot_align(offset + sizeof(u32) * header.recipeCount);
+    header.stringOffset = offset;
+    u32 totalSize = offset + header.stringSize;
+
+    u8 *memory = (u8 *)calloc(1, totalSize);
+    *(SnapshotHeader *)memory = header;
+
+    u8 *strings = memory + header.stringOffset;
+    u32 stringAt = 0;
+
+    SnapshotBuilding *buildings = (SnapshotBuilding *)(memory + header.buildingOffset);
+    for (u32 building = 0; building < calculator->buildingCount; ++building)
+    {
+        BuildingInfo *info = calculator->buildings + building;
+        buildings[building].name.offset = stringAt;
+        buildings[building].name.size = info->name.size;
+        memcpy(strings + stringAt, info->name.data, info->name.size);
+        stringAt += info->name.size;
+        buildings[building].plural.offset = stringAt;
+        buildings[building].plural.size = info->plural.size;
+        memcpy(strings + stringAt, info->plural.data, info->plural.size);
+        stringAt += info->plural.size;
+        buildings[building].power = info->power;
+    }
+
+    SnapshotString *itemNames = (SnapshotString *)(memory + header.itemNameOffset);
+    for (u32 itemId = 0; itemId < calculator->itemCount; ++itemId)
+    {
+        String name = calculator->itemNames[itemId];
+        itemNames[itemId].offset = stringAt;
+        itemNames[itemId].size = name.size;
+        memcpy(strings + stringAt, name.data, name.size);
+        stringAt += name.size;
+    }
+    i_expect(stringAt == header.stringSize);
+
+    memcpy(memory + header.itemMapOffset, calculator->itemMap, sizeof(u32) * (header.itemMapMask + 1));
+    memcpy(memory + header.itemRecipeOffset, calculator->itemRecipes, sizeof(RecipeRange) * header.itemCount);
+
+    SnapshotRecipe *recipes = (SnapshotRecipe *)(memory + header.recipeOffset);
+    for (u32 recipeIdx = 0; recipeIdx < calculator->recipeCount; ++recipeIdx)
+    {
+        Recipe *recipe = calculator->recipes + recipeIdx;
+        SnapshotRecipe *dest = recipes + recipeIdx;
+        dest->building = recipe->building;
+        dest->firstItem = recipe->firstItem;
+        dest->byproductCount = recipe->byproductCount;
+        dest->inputCount = recipe->inputCount;
+        dest->output.id = recipe->output.id;
+        dest->output.itemsPerMinute = recipe->output.itemsPerMinute;
+    }
+
+    SnapshotItem *recipeItems = (SnapshotItem *)(memory + header.recipeItemOffset);
+    for (u32 itemIdx = 0; itemIdx < calculator->recipeItemCount; ++itemIdx)
+    {
+        recipeItems[itemIdx].id = calculator->recipeItems[itemIdx].id;
+        recipeItems[itemIdx].itemsPerMinute = calculator->recipeItems[itemIdx].itemsPerMinute;
+    }
+
+    u32 *producers = (u32 *)(memory + header.producerOffset);
+    for (u32 producerIdx = 0; producerIdx < calculator->recipeCount; ++producerIdx)
+    {
+        producers[producerIdx] = calculator->producers[producerIdx] - calculator->recipes;
+    }
+
+    b32 result = false;
+    FILE *file = fopen(filename, "wb");
+    if (file)
+    {
+        result = fwrite(memory, totalSize, 1, file) == 1;
+        result = (fclose(file) == 0) && result;
+    }
+    if (!result)
+    {
+        fprintf(stderr, "Could not write snapshot '%s'\n", filename);
+    }
+
+    free(memory);
+    return result;
+}
+
+// NOTE(michiel): Hash and displace. The names are spread over the buckets and the biggest buckets go first, each gets
+// the first seed that puts all its names in free slots. Returns false when a bucket finds no seed, it needs more slots.
+internal b32
+build_item_seeds(Calculator *calculator, u32 *hashes, u32 slotMask, u32 *slots, u32 seedMask, u16 *seeds)
+{
+    u32 bucketCount = seedMask + 1;
+    u32 *bucketStarts = (u32 *)calloc(bucketCount + 1, sizeof(u32));
+    u32 *bucketFill = (u32 *)malloc(sizeof(u32) * bucketCount);
+    u32 *bucketItems = (u32 *)malloc(sizeof(u32) * calculator->itemCount);
+    for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+    {
+        ++bucketStarts[(mix_item_hash(hashes[itemId], 0) & seedMask) + 1];
+    }
+    u32 maxBucketSize = 0;
+    for (u32 bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        if (maxBucketSize < bucketStarts[bucket + 1])
+        {
+            maxBucketSize = bucketStarts[bucket + 1];
+        }
+        bucketStarts[bucket + 1] += bucketStarts[bucket];
+        bucketFill[bucket] = bucketStarts[bucket];
+    }
+    for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+    {
+        bucketItems[bucketFill[mix_item_hash(hashes[itemId], 0) & seedMask]++] = itemId;
+    }
+
+    memset(slots, 0, sizeof(u32) * (slotMask + 1));
+    memset(seeds, 0, sizeof(u16) * bucketCount);
+
+    b32 result = true;
+    for (u32 bucketSize = maxBucketSize; result && bucketSize; --bucketSize)
+    {
+        for (u32 bucket = 0; result && (bucket < bucketCount); ++bucket)
+        {
+            u32 *items = bucketItems + bucketStarts[bucket];
+            if ((bucketStarts[bucket + 1] - bucketStarts[bucket]) != bucketSize)
+            {
+                continue;
+            }
+
+            result = false;
+            for (u32 seed = 1; !result && (seed <= 0xFFFF); ++seed)
+            {
+                u32 placed = 0;
+                while (placed < bucketSize)
+                {
+                    u32 *slot = slots + (mix_item_hash(hashes[items[placed]], seed) & slotMask);
+                    if (*slot)
+                    {
+                        break;
+                    }
+                    *slot = items[placed++];
+                }
+
+                if (placed == bucketSize)
+                {
+                    seeds[bucket] = (u16)seed;
+                    result = true;
+                }
+                else
+                {
+                    for (u32 itemIdx = 0; itemIdx < placed; ++itemIdx)
+                    {
+                        slots[mix_item_hash(hashes[items[itemIdx]], seed) & slotMask] = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    free(bucketItems);
+    free(bucketFill);
+    free(bucketStarts);
+    return result;
+}
+
+internal void
+output_builtin_string(OutputBuffer *buffer, String text)
+{
+    if (text.size)
+    {
+        output_fmt(buffer, "{%u, (u8 *)\"", (u32)text.size);
+        for (u32 idx = 0; idx < text.size; ++idx)
+        {
+            u8 c = text.data[idx];
+            if ((c == '"') || (c == '\\')) {
+                output_fmt(buffer, "\\%c", c);
+            } else if ((c < 0x20) || (c >= 0x7F)) {
+                output_fmt(buffer, "\\%03o", c);
+            } else {
+                output_string(buffer, {1, text.data + idx});
+            }
+        }
+        output_string(buffer, static_string("\"}"));
+    }
+    else
+    {
+        output_string(buffer, static_string("{0, 0}"));
+    }
+}
+
+internal void
+output_builtin_item(OutputBuffer *buffer, Item *item)
+{
+    output_string(buffer, static_string("{"));
+    output_builtin_string(buffer, item->name);
+    output_fmt(buffer, ", %u, {%lld, %lld, %.17g}}", item->id, (long long)item->itemsPerMinute.numerator,
+               (long long)item->itemsPerMinute.denominator, item->itemsPerMinute.value);
+}
+
+// NOTE(michiel): Writes the book as static tables for load_builtin_book. Empty tables get one entry, C++ has no empty
+// arrays.
+internal b32
+write_builtin_book(Calculator *calculator, const char *filename)
+{
+    u32 *hashes = (u32 *)malloc(sizeof(u32) * calculator->itemCount);
+    for (u32 itemId = 0; itemId < calculator->itemCount; ++itemId)
+    {
+        hashes[itemId] = hash_item_name(calculator->itemNames[itemId]);
+    }
+
+    u32 slotCount = 1;
+    while (slotCount < calculator->itemCount)
+    {
+        slotCount *= 2;
+    }
+    u32 *slots = 0;
+    u16 *seeds = 0;
+    b32 placed = false;
+    while (!placed)
+    {
+        u32 bucketCount = (slotCount > 1) ? slotCount / 2 : 1;
+        slots = (u32 *)realloc(slots, sizeof(u32) * slotCount);
+        seeds = (u16 *)realloc(seeds, sizeof(u16) * bucketCount);
+        placed = build_item_seeds(calculator, hashes, slotCount - 1, slots, bucketCount - 1, seeds);
+        if (!placed)
+        {
+            slotCount *= 2;
+        }
+    }
+    u32 seedCount = (slotCount > 1) ? slotCount / 2 : 1;
+
+    OutputBuffer buffer = {};
+    output_string(&buffer, static_string("// NOTE(michiel): Generated by satisfactory-calc -H, do not edit\n\n"));
+    output_fmt(&buffer, "#define BUILTIN_BUILDING_COUNT    %u\n", calculator->buildingCount);
+    output_fmt(&buffer, "#define BUILTIN_ITEM_COUNT        %u\n", calculator->itemCount);
+    output_fmt(&buffer, "#define BUILTIN_ITEM_MAP_MASK     %u\n", slotCount - 1);
+    output_fmt(&buffer, "#define BUILTIN_ITEM_SEED_MASK    %u\n", seedCount - 1);
+    output_fmt(&buffer, "#define BUILTIN_RECIPE_COUNT      %u\n", calculator->recipeCount);
+    output_fmt(&buffer, "#define BUILTIN_RECIPE_ITEM_COUNT %u\n\n", calculator->recipeItemCount);
+
+    output_string(&buffer, static_string("global BuildingInfo gBuiltinBuildings[BUILTIN_BUILDING_COUNT ? BUILTIN_BUILDING_COUNT : 1] =\n{\n"));
+    for (u32 building = 0; building < calculator->buildingCount; ++building)
+    {
+        BuildingInfo *info = calculator->buildings + building;
+        output_string(&buffer, static_string("    {"));
+        output_builtin_string(&buffer, info->name);
+        output_string(&buffer, static_string(", "));
+        output_builtin_string(&buffer, info->plural);
+        output_fmt(&buffer, ", %.9g},\n", info->power);
+    }
+
+    output_string(&buffer, static_string("};\n\nglobal String gBuiltinItemNames[BUILTIN_ITEM_COUNT] =\n{\n"));
+    for (u32 itemId = 0; itemId < calculator->itemCount; ++itemId)
+    {
+        output_string(&buffer, static_string("    "));
+        output_builtin_string(&buffer, calculator->itemNames[itemId]);
+        output_string(&buffer, static_string(",\n"));
+    }
+
+    output_string(&buffer, static_string("};\n\nglobal u32 gBuiltinItemMap[BUILTIN_ITEM_MAP_MASK + 1] =\n{"));
+    for (u32 slotIdx = 0; slotIdx < slotCount; ++slotIdx)
+    {
+        output_fmt(&buffer, "%s%u,", (slotIdx % 16) ? " " : "\n    ", slots[slotIdx]);
+    }
+
+    output_string(&buffer, static_string("\n};\n\nglobal u16 gBuiltinItemSeeds[BUILTIN_ITEM_SEED_MASK + 1] =\n{"));
+    for (u32 seedIdx = 0; seedIdx < seedCount; ++seedIdx)
+    {
+        output_fmt(&buffer, "%s%u,", (seedIdx % 16) ? " " : "\n    ", seeds[seedIdx]);
+    }
+
+    output_string(&buffer, static_string("\n};\n\nglobal Item gBuiltinRecipeItems[BUILTIN_RECIPE_ITEM_COUNT ? BUILTIN_RECIPE_ITEM_COUNT : 1] =\n{\n"));
+    for (u32 itemIdx = 0; itemIdx < calculator->recipeItemCount; ++itemIdx)
+    {
+        output_string(&buffer, static_string("    "));
+        output_builtin_item(&buffer, calculator->recipeItems + itemIdx);
+        output_string(&buffer, static_string(",\n"));
+    }
+
+    output_string(&buffer, static_string("};\n\nglobal Recipe gBuiltinRecipes[BUILTIN_RECIPE_COUNT ? BUILTIN_RECIPE_COUNT : 1] =\n{\n"));
+    for (u32 recipeIdx = 0; recipeIdx < calculator->recipeCount; ++recipeIdx)
+    {
+        Recipe *recipe = calculator->recipes + recipeIdx;
+        output_fmt(&buffer, "    {%u, ", recipe->building);
+        output_builtin_item(&buffer, &recipe->output);
+        output_fmt(&buffer, ", %u, %u, %u, gBuiltinRecipeItems + %u, gBuiltinRecipeItems + %u},\n", recipe->firstItem,
+                   recipe->byproductCount, recipe->inputCount, recipe->firstItem,
+                   recipe->firstItem + recipe->byproductCount);
+    }
+
+    output_string(&buffer, static_string("};\n\nglobal RecipeRange gBuiltinItemRecipes[BUILTIN_ITEM_COUNT] =\n{"));
+    for (u32 itemId = 0; itemId < calculator->itemCount; ++itemId)
+    {
+        RecipeRange *range = calculator->itemRecipes + itemId;
+        output_fmt(&buffer, "%s{%u, %u},", (itemId % 8) ? " " : "\n    ", range->firstRecipe, range->recipeCount);
+    }
+
+    output_string(&buffer, static_string("\n};\n\nglobal Recipe *gBuiltinProducers[BUILTIN_RECIPE_COUNT ? BUILTIN_RECIPE_COUNT : 1] =\n{"));
+    for (u32 producerIdx = 0; producerIdx < calculator->recipeCount; ++producerIdx)
+    {
+        output_fmt(&buffer, "%sgBuiltinRecipes + %u,", (producerIdx % 6) ? " " : "\n    ",
+                   (u32)(calculator->producers[producerIdx] - calculator->recipes));
+    }
+
+    output_string(&buffer, static_string("\n};\n\n// NOTE(michiel): Filled in lazily, like the ones reset_unit_costs allocates\n"
+                                         "global UnitCost gBuiltinUnitCosts[BUILTIN_RECIPE_COUNT ? BUILTIN_RECIPE_COUNT : 1];\n"));
+
+    b32 result = false;
+    FILE *file = fopen(filename, "wb");
+    if (file)
+    {
+        result = fwrite(buffer.data, buffer.size, 1, file) == 1;
+        result = (fclose(file) == 0) && result;
+    }
+    if (!result)
+    {
+        fprintf(stderr, "Could not write the built-in book '%s'\n", filename);
+    }
+
+    free(buffer.data);
+    free(seeds);
+    free(slots);
+    free(hashes);
+    return result;
+}
+
+internal void *
+map_file(const char *filename, umm *size)
+{
+    void *result = 0;
+    *size = 0;
+#if _MSC_VER
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart)
+        {
+            HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+            if (mapping)
+            {
+                result = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                *size = (umm)fileSize.QuadPart;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+#else
+    int file = open(filename, O_RDONLY);
+    if (file >= 0)
+    {
+        struct stat fileStat;
+        if ((fstat(file, &fileStat) == 0) && fileStat.st_size)
+        {
+            result = mmap(0, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (result == MAP_FAILED) {
+                result = 0;
+            } else {
+                *size = fileStat.st_size;
+            }
+        }
+        close(file);
+    }
+#endif
+    return result;
+}
+
+internal void
+unmap_file(void *memory, umm size)
+{
+#if _MSC_VER
+    (void)size;
+    UnmapViewOfFile(memory);
+#else
+    munmap(memory, size);
+#endif
+}
+
+// NOTE(michiel): build.sh and build.bat put the executable in gebouw/, next to data/, so the default book is found from
+// the executable and not from the working directory. Falls back to the path it was started with.
+internal const char *
+get_default_book_path(const char *executable, char *buffer, u32 bufferSize)
+{
+    u32 size = 0;
+#if _MSC_VER
+    size = GetModuleFileNameA(0, buffer, bufferSize);
+#else
+    ssize_t linkSize = readlink("/proc/self/exe", buffer, bufferSize);
+    size = (linkSize > 0) ? (u32)linkSize : 0;
+#endif
+    if ((size == 0) || (size >= bufferSize))
+    {
+        size = (u32)strlen(executable);
+        size = (size < bufferSize) ? size : bufferSize - 1;
+        memcpy(buffer, executable, size);
+    }
+
+    while (size && (buffer[size - 1] != '/') && (buffer[size - 1] != '\\'))
+    {
+        --size;
+    }
+    if ((size == 0) && (bufferSize > 2))
+    {
+        buffer[size++] = '.';
+        buffer[size++] = '/';
+    }
+    snprintf(buffer + size, bufferSize - size, "../data/recipes.txt");
+    return buffer;
+}
+
+// NOTE(michiel): Snapshots and the built-in book store the rates as fractions. With -F they have to become doubles, the
+// same as the rates of a parsed book.
+internal void
+approximate_book_rates(Calculator *calculator)
+{
+    if (!gExactRates)
+    {
+        for (u32 recipeIdx = 0; recipeIdx < calculator->recipeCount; ++recipeIdx)
+        {
+            calculator->recipes[recipeIdx].output.itemsPerMinute.denominator = 0;
+        }
+        for (u32 itemIdx = 0; itemIdx < calculator->recipeItemCount; ++itemIdx)
+        {
+            calculator->recipeItems[itemIdx].itemsPerMinute.denominator = 0;
+        }
+    }
+}
+
+internal b32
+is_snapshot_section(umm size, u32 offset, u64 count, umm elementSize)
+{
+    // NOTE(michiel): The counts are at most 32 bits, so the product can not overflow 64 bits
+    return ((offset % 8) == 0) && (offset <= size) && (count * elementSize <= size - offset);
+}
+
+internal b32
+is_snapshot_rate(Rate rate)
+{
+    return (rate.denominator >= 0) && (rate.value == rate.value);
+}
+
+internal b32
+is_snapshot_string(SnapshotHeader *header, SnapshotString string)
+{
+    return (string.offset <= header->stringSize) && (string.size <= header->stringSize - string.offset);
+}
+
+// NOTE(michiel): Every offset, count and id in the file is checked before anything uses it, a truncated or foreign
+// file gets the corrupt message instead of reads out of bounds
+internal b32
+check_snapshot(u8 *base, umm size)
+{
+    SnapshotHeader *header = (SnapshotHeader *)base;
+    b32 result = (size >= sizeof(SnapshotHeader)) && (header->version == SNAPSHOT_VERSION) &&
+                 (header->buildingCount <= MAX_BUILDING_COUNT) && (header->itemCount > 0) &&
+                 ((header->itemMapMask & (header->itemMapMask + 1)) == 0) &&
+                 ((u64)header->itemMapMask + 1 > header->itemCount) &&
+                 is_snapshot_section(size, header->buildingOffset, header->buildingCount, sizeof(SnapshotBuilding)) &&
+                 is_snapshot_section(size, header->itemNameOffset, header->itemCount, sizeof(SnapshotString)) &&
+                 is_snapshot_section(size, header->itemMapOffset, (u64)header->itemMapMask + 1, sizeof(u32)) &&
+                 is_snapshot_section(size, header->itemRecipeOffset, header->itemCount, sizeof(RecipeRange)) &&
+                 is_snapshot_section(size, header->recipeOffset, header->recipeCount, sizeof(SnapshotRecipe)) &&
+                 is_snapshot_section(size, header->recipeItemOffset, header->recipeItemCount, sizeof(SnapshotItem)) &&
+                 is_snapshot_section(size, header->producerOffset, header->recipeCount, sizeof(u32)) &&
+                 (header->stringOffset <= size) && (header->stringSize <= size - header->stringOffset);
+
+    if (result)
+    {
+        SnapshotBuilding *buildings = (SnapshotBuilding *)(base + header->buildingOffset);
+        for (u32 building = 0; result && (building < header->buildingCount); ++building)
+        {
+            result = is_snapshot_string(header, buildings[building].name) &&
+                     is_snapshot_string(header, buildings[building].plural);
+        }
+
+        SnapshotString *itemNames = (SnapshotString *)(base + header->itemNameOffset);
+        RecipeRange *itemRecipes = (RecipeRange *)(base + header->itemRecipeOffset);
+        for (u32 itemId = 0; result && (itemId < header->itemCount); ++itemId)
+        {
+            result = is_snapshot_string(header, itemNames[itemId]) &&
+                     ((u64)itemRecipes[itemId].firstRecipe + itemRecipes[itemId].recipeCount <= header->recipeCount);
+        }
+
+        // NOTE(michiel): The lookup probes until it finds an empty slot, so there has to be one
+        u32 *itemMap = (u32 *)(base + header->itemMapOffset);
+        u32 usedSlots = 0;
+        for (u32 slot = 0; result && (slot <= header->itemMapMask); ++slot)
+        {
+            result = itemMap[slot] < header->itemCount;
+            usedSlots += itemMap[slot] ? 1 : 0;
+        }
+        result = result && (usedSlots <= header->itemMapMask);
+
+        SnapshotItem *recipeItems = (SnapshotItem *)(base + header->recipeItemOffset);
+        for (u32 itemIdx = 0; result && (itemIdx < header->recipeItemCount); ++itemIdx)
+        {
+            result = (recipeItems[itemIdx].id < header->itemCount) && is_snapshot_rate(recipeItems[itemIdx].itemsPerMinute);
+        }
+
+        SnapshotRecipe *recipes = (SnapshotRecipe *)(base + header->recipeOffset);
+        for (u32 recipeIdx = 0; result && (recipeIdx < header->recipeCount); ++recipeIdx)
+        {
+            SnapshotRecipe *recipe = recipes + recipeIdx;
+            result = ((recipe->building == 0) || (recipe->building < header->buildingCount)) &&
+                     (recipe->output.id < header->itemCount) && is_snapshot_rate(recipe->output.itemsPerMinute) &&
+                     (to_f64(recipe->output.itemsPerMinute) > 0.0) &&
+                     ((u64)recipe->firstItem + recipe->byproductCount + recipe->inputCount <= header->recipeItemCount);
+        }
+
+        u32 *producers = (u32 *)(base + header->producerOffset);
+        for (u32 producerIdx = 0; result && (producerIdx < header->recipeCount); ++producerIdx)
+        {
+            result = producers[producerIdx] < header->recipeCount;
+        }
+    }
+    return result;
+}
+
+internal b32
+load_snapshot(Calculator *calculator, const char *filename, void *memory, umm size)
+{
+    u8 *base = (u8 *)memory;
+    SnapshotHeader *header = (SnapshotHeader *)base;
+
+    b32 result = check_snapshot(base, size);
+    if (result)
+    {
+        calculator->snapshot = memory;
+        calculator->snapshotSize = size;
+
+        u8 *strings = base + header->stringOffset;
+        SnapshotBuilding *buildings = (SnapshotBuilding *)(base + header->buildingOffset);
+        calculator->buildingCount = header->buildingCount;
+        for (u32 building = 0; building < header->buildingCount; ++building)
+        {
+            BuildingInfo *info = calculator->buildings + building;
+            info->name.size = buildings[building].name.size;
+            info->name.data = strings + buildings[building].name.offset;
+            info->plural.size = buildings[building].plural.size;
+            info->plural.data = strings + buildings[building].plural.offset;
+            info->power = buildings[building].power;
+        }
+
+        SnapshotString *itemNames = (SnapshotString *)(base + header->itemNameOffset);
+        calculator->maxItemCount = header->itemCount;
+        calculator->itemCount = header->itemCount;
+        calculator->itemNames = (String *)malloc(sizeof(String) * header->itemCount);
+        for (u32 itemId = 0; itemId < header->itemCount; ++itemId)
+        {
+            calculator->itemNames[itemId].size = itemNames[itemId].size;
+            calculator->itemNames[itemId].data = strings + itemNames[itemId].offset;
+        }
+        calculator->itemMapMask = header->itemMapMask;
+        calculator->itemMap = (u32 *)(base + header->itemMapOffset);
+        calculator->itemRecipes = (RecipeRange *)(base + header->itemRecipeOffset);
+
+        SnapshotItem *recipeItems = (SnapshotItem *)(base + header->recipeItemOffset);
+        reserve_recipe_items(calculator, header->recipeItemCount);
+        calculator->recipeItemCount = header->recipeItemCount;
+        for (u32 itemIdx = 0; itemIdx < header->recipeItemCount; ++itemIdx)
+        {
+            Item *item = calculator->recipeItems + itemIdx;
+            item->id = recipeItems[itemIdx].id;
+            item->name = calculator->itemNames[item->id];
+            item->itemsPerMinute = recipeItems[itemIdx].itemsPerMinute;
+        }
+
+        SnapshotRecipe *recipes = (SnapshotRecipe *)(base + header->recipeOffset);
+        reserve_recipes(calculator, header->recipeCount);
+        calculator->recipeCount = header->recipeCount;
+        for (u32 recipeIdx = 0; recipeIdx < header->recipeCount; ++recipeIdx)
+        {
+            SnapshotRecipe *source = recipes + recipeIdx;
+            Recipe *recipe = calculator->recipes + recipeIdx;
+            *recipe = {};
+            recipe->building = source->building;
+            recipe->output.id = source->output.id;
+            recipe->output.name = calculator->itemNames[source->output.id];
+            recipe->output.itemsPerMinute = source->output.itemsPerMinute;
+            recipe->firstItem = source->firstItem;
+            recipe->byproductCount = source->byproductCount;
+            recipe->inputCount = source->inputCount;
+            recipe->byproducts = calculator->recipeItems + source->firstItem;
+            recipe->inputs = recipe->byproducts + source->byproductCount;
+        }
+
+        u32 *producers = (u32 *)(base + header->producerOffset);
+        calculator->producers = (Recipe **)malloc(sizeof(Recipe *) * (header->recipeCount ? header->recipeCount : 1));
+        for (u32 producerIdx = 0; producerIdx < header->recipeCount; ++producerIdx)
+        {
+            calculator->producers[producerIdx] = calculator->recipes + producers[producerIdx];
+        }
+
+        approximate_book_rates(calculator);
+        reset_unit_costs(calculator);
+    }
+    else
+    {
+        fprintf(stderr, "Snapshot '%s' is corrupt or from another version, rewrite it with -w\n", filename);
+    }
+
+    return result;
+}
+
+internal b32
+load_recipe_book(Calculator *calculator, const char *filename)
+{
+    b32 result = false;
+
+    umm size;
+    void *memory = map_file(filename, &size);
+    if (memory)
+    {
+        if ((size >= sizeof(u32)) && (*(u32 *)memory == SNAPSHOT_MAGIC))
+        {
+            result = load_snapshot(calculator, filename, memory, size);
+            if (!result)
+            {
+                unmap_file(memory, size);
+            }
+        }
+        else
+        {
+            // NOTE(michiel): Item names get interned, so the text does not have to stay around
+            String text = {size, (u8 *)memory};
+            result = parse_recipe_book(calculator, string(filename), text);
+            unmap_file(memory, size);
+            if (result)
+            {
+                build_recipe_index(calculator);
+            }
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Could not open recipe book '%s'\n", filename);
+    }
+
+    return result;
+}
+
+#if SATISFACTORY_CALC_BUILTIN_BOOK
+#include "builtin_book.h"
+
+// NOTE(michiel): No parsing, hashing or allocation, the tables are ready to use as the compiler laid them out
+internal void
+load_builtin_book(Calculator *calculator)
+{
+    calculator->snapshot = gBuiltinRecipes;
+    calculator->snapshotSize = 0;
+
+    calculator->buildingCount = BUILTIN_BUILDING_COUNT;
+    memcpy(calculator->buildings, gBuiltinBuildings, sizeof(BuildingInfo) * BUILTIN_BUILDING_COUNT);
+
+    calculator->maxItemCount = BUILTIN_ITEM_COUNT;
+    calculator->itemCount = BUILTIN_ITEM_COUNT;
+    calculator->itemNames = gBuiltinItemNames;
+    calculator->itemMapMask = BUILTIN_ITEM_MAP_MASK;
+    calculator->itemMap = gBuiltinItemMap;
+    calculator->itemSeedMask = BUILTIN_ITEM_SEED_MASK;
+    calculator->itemSeeds = gBuiltinItemSeeds;
+
+    calculator->maxRecipeCount = BUILTIN_RECIPE_COUNT;
+    calculator->recipeCount = BUILTIN_RECIPE_COUNT;
+    calculator->recipes = gBuiltinRecipes;
+    calculator->maxRecipeItemCount = BUILTIN_RECIPE_ITEM_COUNT;
+    calculator->recipeItemCount = BUILTIN_RECIPE_ITEM_COUNT;
+    calculator->recipeItems = gBuiltinRecipeItems;
+
+    calculator->itemRecipes = gBuiltinItemRecipes;
+    calculator->producers = gBuiltinProducers;
+    calculator->unitCosts = gBuiltinUnitCosts;
+    approximate_book_rates(calculator);
+}
+#endif
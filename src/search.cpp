@@ -0,0 +1,446 @@
+// NOTE(michiel): Name search over the items that have a recipe, for the suggestions when a name is not found and for
+// autocompletion (:find in a session). Every item is in the index once, no matter how many alternates it has.
+// Fuzzy search goes over trigram postings: the lower case name, with a space before and after, is cut in overlapping
+// runs of three characters. The entries that share the most trigrams with the query (relative to the trigrams of both)
+// are reranked on their edit distance to the query, per word, and the ones that are too far off are dropped. Prefix
+// completion is a binary search, the entries are sorted on
+// their lower case name. The index is built on the first search, so books that are only queried never pay for it.
+
+#define MAX_SEARCH_QUERY_SIZE 128
+#define SEARCH_CANDIDATE_COUNT 32
+#define MAX_FIND_RESULTS 10
+
+struct NameEntry
+{
+    String name;            // NOTE(michiel): Lower case
+    u32 itemId;
+    u32 trigramCount;
+};
+
+struct NameIndex
+{
+    u32 entryCount;
+    NameEntry *entries;     // NOTE(michiel): Sorted on the name
+    u8 *names;
+    u32 maxNameSize;
+
+    // NOTE(michiel): The entries of trigram n are postings[postingStarts[n]] up to postings[postingStarts[n + 1]],
+    // in entry order and without duplicates
+    u32 trigramCount;
+    u32 *trigrams;
+    u32 *postingStarts;
+    u32 *postings;
+
+    // NOTE(michiel): Scratch for one search, the hits are cleared again after every search
+    u16 *hitCounts;
+    u32 *hitEntries;
+    u32 *distanceRows;
+};
+
+struct NameMatch
+{
+    u32 itemId;
+    u32 distance;
+    f32 similarity;
+};
+
+internal u32
+get_trigram(u8 *text, u32 at, u32 size)
+{
+    // NOTE(michiel): The text is seen as padded with one space on both sides
+    u8 chars[3];
+    for (u32 idx = 0; idx < 3; ++idx)
+    {
+        u32 textIdx = at + idx;
+        chars[idx] = ((textIdx == 0) || (textIdx > size)) ? ' ' : text[textIdx - 1];
+    }
+    return ((u32)chars[0] << 16) | ((u32)chars[1] << 8) | chars[2];
+}
+
+internal s32
+compare_names(String a, String b)
+{
+    s32 result = memcmp(a.data, b.data, (a.size < b.size) ? a.size : b.size);
+    if (result == 0)
+    {
+        result = (a.size < b.size) ? -1 : ((a.size > b.size) ? 1 : 0);
+    }
+    return result;
+}
+
+internal int
+compare_name_entries(const void *a, const void *b)
+{
+    return compare_names(((NameEntry *)a)->name, ((NameEntry *)b)->name);
+}
+
+internal int
+compare_u64(const void *a, const void *b)
+{
+    u64 left = *(u64 *)a;
+    u64 right = *(u64 *)b;
+    return (left < right) ? -1 : ((left > right) ? 1 : 0);
+}
+
+internal NameIndex *
+build_name_index(Calculator *calculator)
+{
+    NameIndex *index = (NameIndex *)calloc(1, sizeof(NameIndex));
+
+    umm namesSize = 0;
+    for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+    {
+        if (get_recipes(calculator, itemId).count)
+        {
+            ++index->entryCount;
+            namesSize += calculator->itemNames[itemId].size;
+        }
+    }
+
+    index->entries = (NameEntry *)malloc(sizeof(NameEntry) * (index->entryCount ? index->entryCount : 1));
+    index->names = (u8 *)malloc(namesSize ? namesSize : 1);
+    u32 entryIdx = 0;
+    u8 *at = index->names;
+    for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+    {
+        if (get_recipes(calculator, itemId).count)
+        {
+            String name = calculator->itemNames[itemId];
+            NameEntry *entry = index->entries + entryIdx++;
+            entry->name = {name.size, at};
+            entry->itemId = itemId;
+            entry->trigramCount = 0;
+            for (u32 idx = 0; idx < name.size; ++idx)
+            {
+                *at++ = to_lower_case(name.data[idx]);
+            }
+            if (index->maxNameSize < name.size)
+            {
+                index->maxNameSize = (u32)name.size;
+            }
+        }
+    }
+    qsort(index->entries, index->entryCount, sizeof(NameEntry), compare_name_entries);
+
+    // NOTE(michiel): A name of n characters has n trigrams, sorting (trigram, entry) pairs groups the postings
+    u64 *pairs = (u64 *)malloc(sizeof(u64) * (namesSize ? namesSize : 1));
+    u32 pairCount = 0;
+    for (entryIdx = 0; entryIdx < index->entryCount; ++entryIdx)
+    {
+        String name = index->entries[entryIdx].name;
+        for (u32 idx = 0; idx < name.size; ++idx)
+        {
+            pairs[pairCount++] = ((u64)get_trigram(name.data, idx, (u32)name.size) << 32) | entryIdx;
+        }
+    }
+    qsort(pairs, pairCount, sizeof(u64), compare_u64);
+
+    index->trigrams = (u32 *)malloc(sizeof(u32) * (pairCount ? pairCount : 1));
+    index->postingStarts = (u32 *)malloc(sizeof(u32) * (pairCount + 1));
+    index->postings = (u32 *)malloc(sizeof(u32) * (pairCount ? pairCount : 1));
+    u32 postingCount = 0;
+    for (u32 pairIdx = 0; pairIdx < pairCount; ++pairIdx)
+    {
+        if (pairIdx && (pairs[pairIdx] == pairs[pairIdx - 1]))
+        {
+            continue;
+        }
+
+        u32 trigram = (u32)(pairs[pairIdx] >> 32);
+        u32 entry = (u32)pairs[pairIdx];
+        if (!index->trigramCount || (index->trigrams[index->trigramCount - 1] != trigram))
+        {
+            index->postingStarts[index->trigramCount] = postingCount;
+            index->trigrams[index->trigramCount++] = trigram;
+        }
+        index->postings[postingCount++] = entry;
+        ++index->entries[entry].trigramCount;
+    }
+    index->postingStarts[index->trigramCount] = postingCount;
+    free(pairs);
+
+    index->hitCounts = (u16 *)calloc(index->entryCount ? index->entryCount : 1, sizeof(u16));
+    index->hitEntries = (u32 *)malloc(sizeof(u32) * (index->entryCount ? index->entryCount : 1));
+    index->distanceRows = (u32 *)malloc(sizeof(u32) * 2 * (index->maxNameSize + 1));
+    return index;
+}
+
+internal void
+free_name_index(NameIndex *index)
+{
+    if (index)
+    {
+        free(index->entries);
+        free(index->names);
+        free(index->trigrams);
+        free(index->postingStarts);
+        free(index->postings);
+        free(index->hitCounts);
+        free(index->hitEntries);
+        free(index->distanceRows);
+        free(index);
+    }
+}
+
+internal NameIndex *
+get_name_index(Calculator *calculator)
+{
+    if (!calculator->nameIndex)
+    {
+        calculator->nameIndex = build_name_index(calculator);
+    }
+    return calculator->nameIndex;
+}
+
+// NOTE(michiel): Lower cases into the buffer, the query is cut off at MAX_SEARCH_QUERY_SIZE
+internal String
+get_search_query(String text, u8 *buffer)
+{
+    String result = {(text.size < MAX_SEARCH_QUERY_SIZE) ? text.size : MAX_SEARCH_QUERY_SIZE, buffer};
+    for (u32 idx = 0; idx < result.size; ++idx)
+    {
+        buffer[idx] = to_lower_case(text.data[idx]);
+    }
+    return result;
+}
+
+// NOTE(michiel): Levenshtein, with one row over the name per query character
+internal u32
+get_edit_distance(NameIndex *index, String query, String name)
+{
+    u32 *prevRow = index->distanceRows;
+    u32 *row = prevRow + name.size + 1;
+    for (u32 nameIdx = 0; nameIdx <= name.size; ++nameIdx)
+    {
+        prevRow[nameIdx] = nameIdx;
+    }
+    for (u32 queryIdx = 0; queryIdx < query.size; ++queryIdx)
+    {
+        row[0] = queryIdx + 1;
+        for (u32 nameIdx = 0; nameIdx < name.size; ++nameIdx)
+        {
+            u32 cost = prevRow[nameIdx] + ((query.data[queryIdx] == name.data[nameIdx]) ? 0 : 1);
+            u32 insert = row[nameIdx] + 1;
+            u32 remove = prevRow[nameIdx + 1] + 1;
+            cost = (insert < cost) ? insert : cost;
+            row[nameIdx + 1] = (remove < cost) ? remove : cost;
+        }
+        u32 *swap = prevRow;
+        prevRow = row;
+        row = swap;
+    }
+    return prevRow[name.size];
+}
+
+internal b32
+contains_text(String text, String part)
+{
+    b32 result = false;
+    for (umm at = 0; !result && (at + part.size <= text.size); ++at)
+    {
+        result = memcmp(text.data + at, part.data, part.size) == 0;
+    }
+    return result;
+}
+
+// NOTE(michiel): Every word of the query is matched against the closest word of the name, the name can have more
+// words. So 'heavy frame' is close to 'heavy modular frame' and 'copper' to 'copper sheet', which a distance over the
+// whole names gets wrong. A query word that is part of a name word is a match as well, 'comp' is as close to
+// 'supercomputer' as it can get.
+internal u32
+get_word_distance(NameIndex *index, String query, String name)
+{
+    u32 result = 0;
+    String queryRest = query;
+    while (queryRest.size)
+    {
+        String queryWord = split_off(&queryRest, static_string(" "));
+        if (queryWord.size)
+        {
+            u32 bestDistance = (u32)queryWord.size;
+            String nameRest = name;
+            while (nameRest.size)
+            {
+                String nameWord = split_off(&nameRest, static_string(" "));
+                u32 distance = contains_text(nameWord, queryWord) ? 0 : get_edit_distance(index, queryWord, nameWord);
+                bestDistance = (distance < bestDistance) ? distance : bestDistance;
+            }
+            result += bestDistance;
+        }
+    }
+    return result;
+}
+
+internal b32
+is_better_match(NameMatch *a, NameMatch *b)
+{
+    return (a->distance < b->distance) || ((a->distance == b->distance) && (a->similarity > b->similarity));
+}
+
+// NOTE(michiel): Fills up to maxResults matches, best first. Only names that share a trigram with the query count, and
+// only if at most half of the query characters have to change to get to them.
+internal u32
+search_item_names(Calculator *calculator, String text, u32 maxResults, NameMatch *results)
+{
+    NameIndex *index = get_name_index(calculator);
+    u8 queryBuffer[MAX_SEARCH_QUERY_SIZE];
+    String query = get_search_query(text, queryBuffer);
+
+    // NOTE(michiel): Trigrams that show up more than once in the query count once, like they do for the names
+    u32 queryTrigrams[MAX_SEARCH_QUERY_SIZE];
+    u32 queryTrigramCount = 0;
+    for (u32 idx = 0; idx < query.size; ++idx)
+    {
+        u32 trigram = get_trigram(query.data, idx, (u32)query.size);
+        b32 duplicate = false;
+        for (u32 testIdx = 0; testIdx < queryTrigramCount; ++testIdx)
+        {
+            duplicate = duplicate || (queryTrigrams[testIdx] == trigram);
+        }
+        if (!duplicate)
+        {
+            queryTrigrams[queryTrigramCount++] = trigram;
+        }
+    }
+
+    u32 hitEntryCount = 0;
+    for (u32 trigramIdx = 0; trigramIdx < queryTrigramCount; ++trigramIdx)
+    {
+        u32 low = 0;
+        u32 high = index->trigramCount;
+        while (low < high)
+        {
+            u32 middle = low + (high - low) / 2;
+            if (index->trigrams[middle] < queryTrigrams[trigramIdx]) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if ((low < index->trigramCount) && (index->trigrams[low] == queryTrigrams[trigramIdx]))
+        {
+            for (u32 postingIdx = index->postingStarts[low]; postingIdx < index->postingStarts[low + 1]; ++postingIdx)
+            {
+                u32 entry = index->postings[postingIdx];
+                if (index->hitCounts[entry]++ == 0)
+                {
+                    index->hitEntries[hitEntryCount++] = entry;
+                }
+            }
+        }
+    }
+
+    // NOTE(michiel): Keep the candidates with the highest trigram similarity (shared over the union), sorted
+    NameMatch candidates[SEARCH_CANDIDATE_COUNT];
+    u32 entries[SEARCH_CANDIDATE_COUNT];
+    u32 candidateCount = 0;
+    for (u32 hitIdx = 0; hitIdx < hitEntryCount; ++hitIdx)
+    {
+        u32 entry = index->hitEntries[hitIdx];
+        u32 hits = index->hitCounts[entry];
+        index->hitCounts[entry] = 0;
+
+        NameMatch match = {};
+        match.itemId = index->entries[entry].itemId;
+        match.similarity = (f32)hits / (f32)(queryTrigramCount + index->entries[entry].trigramCount - hits);
+        if ((candidateCount < SEARCH_CANDIDATE_COUNT) || (candidates[candidateCount - 1].similarity < match.similarity))
+        {
+            u32 insertIdx = (candidateCount < SEARCH_CANDIDATE_COUNT) ? candidateCount++ : candidateCount - 1;
+            while (insertIdx && (candidates[insertIdx - 1].similarity < match.similarity))
+            {
+                candidates[insertIdx] = candidates[insertIdx - 1];
+                entries[insertIdx] = entries[insertIdx - 1];
+                --insertIdx;
+            }
+            candidates[insertIdx] = match;
+            entries[insertIdx] = entry;
+        }
+    }
+
+    u32 queryLetterCount = 0;
+    for (u32 idx = 0; idx < query.size; ++idx)
+    {
+        queryLetterCount += (query.data[idx] != ' ') ? 1 : 0;
+    }
+
+    u32 resultCount = 0;
+    for (u32 candidateIdx = 0; candidateIdx < candidateCount; ++candidateIdx)
+    {
+        NameMatch match = candidates[candidateIdx];
+        match.distance = get_word_distance(index, query, index->entries[entries[candidateIdx]].name);
+        if (2 * match.distance > queryLetterCount)
+        {
+            continue;
+        }
+        if ((resultCount < maxResults) || is_better_match(&match, results + resultCount - 1))
+        {
+            u32 insertIdx = (resultCount < maxResults) ? resultCount++ : resultCount - 1;
+            while (insertIdx && is_better_match(&match, results + insertIdx - 1))
+            {
+                results[insertIdx] = results[insertIdx - 1];
+                --insertIdx;
+            }
+            results[insertIdx] = match;
+        }
+    }
+    return resultCount;
+}
+
+// NOTE(michiel): Fills up to maxResults item ids whose name starts with the prefix, in alphabetical order
+internal u32
+complete_item_names(Calculator *calculator, String text, u32 maxResults, u32 *itemIds)
+{
+    NameIndex *index = get_name_index(calculator);
+    u8 prefixBuffer[MAX_SEARCH_QUERY_SIZE];
+    String prefix = get_search_query(text, prefixBuffer);
+
+    u32 low = 0;
+    u32 high = index->entryCount;
+    while (low < high)
+    {
+        u32 middle = low + (high - low) / 2;
+        if (compare_names(index->entries[middle].name, prefix) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    u32 resultCount = 0;
+    for (u32 entryIdx = low; (entryIdx < index->entryCount) && (resultCount < maxResults); ++entryIdx)
+    {
+        String name = index->entries[entryIdx].name;
+        if ((name.size < prefix.size) || (memcmp(name.data, prefix.data, prefix.size) != 0))
+        {
+            break;
+        }
+        itemIds[resultCount++] = index->entries[entryIdx].itemId;
+    }
+    return resultCount;
+}
+
+// NOTE(michiel): For autocompletion, the completions of the text first and then the fuzzy matches
+internal u32
+find_item_names(Calculator *calculator, String text, u32 maxResults, u32 *itemIds)
+{
+    u32 resultCount = complete_item_names(calculator, text, maxResults, itemIds);
+    if (resultCount < maxResults)
+    {
+        NameMatch matches[SEARCH_CANDIDATE_COUNT];
+        u32 matchCount = search_item_names(calculator, text, (maxResults < SEARCH_CANDIDATE_COUNT) ? maxResults :
+                                           SEARCH_CANDIDATE_COUNT, matches);
+        for (u32 matchIdx = 0; (matchIdx < matchCount) && (resultCount < maxResults); ++matchIdx)
+        {
+            b32 duplicate = false;
+            for (u32 testIdx = 0; testIdx < resultCount; ++testIdx)
+            {
+                duplicate = duplicate || (itemIds[testIdx] == matches[matchIdx].itemId);
+            }
+            if (!duplicate)
+            {
+                itemIds[resultCount++] = matches[matchIdx].itemId;
+            }
+        }
+    }
+    return resultCount;
+}
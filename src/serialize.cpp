@@ -0,0 +1,555 @@
+// NOTE(michiel): Machine readable output. The plan tree, totals and costs are walked once and every value goes through
+// the record writer, which writes it as JSON (one document per query, on a single line) or as CSV rows. Numbers are
+// written with enough digits to read back the exact same double.
+
+enum OutputFormat
+{
+    Format_Text,
+    Format_Json,
+    Format_Csv,
+};
+
+enum RecordField
+{
+    Field_Kind,
+    Field_Item,
+    Field_Building,
+    Field_PerMinute,
+    Field_ProducedPerMinute,
+    Field_UsedExtraPerMinute,
+    Field_ExtraPerMinute,
+    Field_Buildings,
+    Field_PowerMW,
+    Field_Belts,
+
+    Field_Count,
+};
+
+// NOTE(michiel): Used as the JSON keys and the CSV column names
+global const char *gRecordFieldNames[Field_Count] =
+{
+    "kind", "item", "building", "per_minute", "produced_per_minute", "used_extra_per_minute", "extra_per_minute",
+    "buildings", "power_mw", "belts",
+};
+
+struct RecordWriter
+{
+    OutputFormat format;
+    OutputBuffer *buffer;
+    QueryArena *arena;
+    u32 beltTier;
+
+    // NOTE(michiel): JSON, one flag per open object or array to know if the next element needs a comma. Every plan
+    // level opens two, so the flags grow in the arena with the depth of the plan.
+    u32 nesting;
+    u32 maxNesting;
+    u8 *isFirst;
+
+    // NOTE(michiel): CSV, a record is a row that gets written when its first child list starts or when it ends
+    u32 resultIndex;
+    u32 openRecords;
+    b32 rowPending;
+    String section;
+    String columns[Field_Count];
+    char numbers[Field_Count][32];
+};
+
+internal String
+format_number(char *buffer, u32 size, f64 value)
+{
+    s32 length = snprintf(buffer, size, "%.15g", value);
+    if (strtod(buffer, 0) != value)
+    {
+        length = snprintf(buffer, size, "%.17g", value);
+    }
+    String result = {(umm)length, (u8 *)buffer};
+    return result;
+}
+
+// NOTE(michiel): The writer lives in the query arena, like the plan it writes
+internal RecordWriter *
+push_record_writer(TextOutput output, OutputFormat format, u32 beltTier)
+{
+    RecordWriter *result = arena_push_struct(output.arena, RecordWriter);
+    result->format = format;
+    result->buffer = output.buffer;
+    result->arena = output.arena;
+    result->beltTier = beltTier;
+    return result;
+}
+
+internal void
+json_separator(RecordWriter *writer)
+{
+    if (!writer->isFirst[writer->nesting])
+    {
+        output_string(writer->buffer, static_string(","));
+    }
+    writer->isFirst[writer->nesting] = false;
+}
+
+internal void
+json_open(RecordWriter *writer, const char *name, char bracket)
+{
+    json_separator(writer);
+    if (name)
+    {
+        output_fmt(writer->buffer, "\"%s\":", name);
+    }
+    output_fmt(writer->buffer, "%c", bracket);
+    ++writer->nesting;
+    if (writer->nesting >= writer->maxNesting)
+    {
+        u32 maxNesting = writer->maxNesting ? 2 * writer->maxNesting : 64;
+        u8 *isFirst = arena_push_array(writer->arena, maxNesting, u8);
+        if (writer->maxNesting)
+        {
+            memcpy(isFirst, writer->isFirst, writer->maxNesting);
+        }
+        writer->isFirst = isFirst;
+        writer->maxNesting = maxNesting;
+    }
+    writer->isFirst[writer->nesting] = true;
+}
+
+internal void
+json_close(RecordWriter *writer, char bracket)
+{
+    i_expect(writer->nesting);
+    --writer->nesting;
+    output_fmt(writer->buffer, "%c", bracket);
+}
+
+internal void
+json_string(OutputBuffer *buffer, String text)
+{
+    output_string(buffer, static_string("\""));
+    for (u32 idx = 0; idx < text.size; ++idx)
+    {
+        u8 c = text.data[idx];
+        if ((c == '"') || (c == '\\')) {
+            output_fmt(buffer, "\\%c", c);
+        } else if (c < 0x20) {
+            output_fmt(buffer, "\\u%04x", c);
+        } else {
+            output_string(buffer, {1, text.data + idx});
+        }
+    }
+    output_string(buffer, static_string("\""));
+}
+
+internal void
+csv_string(OutputBuffer *buffer, String text)
+{
+    b32 needsQuotes = false;
+    for (u32 idx = 0; idx < text.size; ++idx)
+    {
+        u8 c = text.data[idx];
+        if ((c == ',') || (c == '"') || (c == '\n') || (c == '\r'))
+        {
+            needsQuotes = true;
+            break;
+        }
+    }
+
+    if (needsQuotes)
+    {
+        output_string(buffer, static_string("\""));
+        for (u32 idx = 0; idx < text.size; ++idx)
+        {
+            if (text.data[idx] == '"')
+            {
+                output_string(buffer, static_string("\""));
+            }
+            output_string(buffer, {1, text.data + idx});
+        }
+        output_string(buffer, static_string("\""));
+    }
+    else
+    {
+        output_string(buffer, text);
+    }
+}
+
+internal void
+csv_flush_row(RecordWriter *writer)
+{
+    if (writer->rowPending)
+    {
+        OutputBuffer *buffer = writer->buffer;
+        output_fmt(buffer, "%u,", writer->resultIndex);
+        csv_string(buffer, writer->section);
+        output_fmt(buffer, ",%u", writer->openRecords - 1);
+        for (u32 field = 0; field < Field_Count; ++field)
+        {
+            output_string(buffer, static_string(","));
+            csv_string(buffer, writer->columns[field]);
+        }
+        output_string(buffer, static_string("\n"));
+        writer->rowPending = false;
+    }
+}
+
+internal void
+begin_document(RecordWriter *writer)
+{
+    if (writer->format == Format_Json)
+    {
+        if (!writer->maxNesting)
+        {
+            writer->maxNesting = 64;
+            writer->isFirst = arena_push_array(writer->arena, writer->maxNesting, u8);
+        }
+        writer->nesting = 0;
+        writer->isFirst[0] = true;
+        json_open(writer, 0, '{');
+        json_open(writer, "results", '[');
+    }
+    else
+    {
+        output_string(writer->buffer, static_string("result,section,depth"));
+        for (u32 field = 0; field < Field_Count; ++field)
+        {
+            output_fmt(writer->buffer, ",%s", gRecordFieldNames[field]);
+        }
+        output_string(writer->buffer, static_string("\n"));
+        writer->resultIndex = 0;
+    }
+}
+
+internal void
+end_document(RecordWriter *writer)
+{
+    if (writer->format == Format_Json)
+    {
+        json_close(writer, ']');
+        json_close(writer, '}');
+        output_string(writer->buffer, static_string("\n"));
+    }
+}
+
+// NOTE(michiel): A result is one solved plan, a query for a single item gives one per recipe of that item
+internal void
+begin_result(RecordWriter *writer)
+{
+    if (writer->format == Format_Json)
+    {
+        json_open(writer, 0, '{');
+    }
+}
+
+internal void
+end_result(RecordWriter *writer)
+{
+    if (writer->format == Format_Json)
+    {
+        json_close(writer, '}');
+    }
+    else
+    {
+        ++writer->resultIndex;
+    }
+}
+
+// NOTE(michiel): A list directly in a result is a section, inside a record it holds the child records
+internal void
+begin_list(RecordWriter *writer, const char *name)
+{
+    if (writer->format == Format_Json)
+    {
+        json_open(writer, name, '[');
+    }
+    else if (writer->openRecords)
+    {
+        csv_flush_row(writer);
+    }
+    else
+    {
+        writer->section = string(name);
+    }
+}
+
+internal void
+end_list(RecordWriter *writer)
+{
+    if (writer->format == Format_Json)
+    {
+        json_close(writer, ']');
+    }
+}
+
+internal void
+begin_record(RecordWriter *writer)
+{
+    if (writer->format == Format_Json)
+    {
+        json_open(writer, 0, '{');
+    }
+    else
+    {
+        csv_flush_row(writer);
+        ++writer->openRecords;
+        writer->rowPending = true;
+        for (u32 field = 0; field < Field_Count; ++field)
+        {
+            writer->columns[field] = {};
+        }
+    }
+}
+
+internal void
+end_record(RecordWriter *writer)
+{
+    if (writer->format == Format_Json)
+    {
+        json_close(writer, '}');
+    }
+    else
+    {
+        csv_flush_row(writer);
+        i_expect(writer->openRecords);
+        --writer->openRecords;
+    }
+}
+
+internal void
+write_string(RecordWriter *writer, RecordField field, String value)
+{
+    if (writer->format == Format_Json)
+    {
+        json_separator(writer);
+        output_fmt(writer->buffer, "\"%s\":", gRecordFieldNames[field]);
+        json_string(writer->buffer, value);
+    }
+    else
+    {
+        writer->columns[field] = value;
+    }
+}
+
+internal void
+write_number(RecordWriter *writer, RecordField field, f64 value)
+{
+    String number = format_number(writer->numbers[field], sizeof(writer->numbers[field]), value);
+    if (writer->format == Format_Json)
+    {
+        json_separator(writer);
+        output_fmt(writer->buffer, "\"%s\":%.*s", gRecordFieldNames[field], STR_FMT(number));
+    }
+    else
+    {
+        writer->columns[field] = number;
+    }
+}
+
+internal void
+write_rate(RecordWriter *writer, RecordField field, Rate value)
+{
+    write_number(writer, field, to_f64(value));
+}
+
+// NOTE(michiel): A single value of the result, a key in JSON and a row of its own in CSV
+internal void
+write_summary(RecordWriter *writer, const char *name, RecordField field, f64 value)
+{
+    if (writer->format == Format_Json)
+    {
+        char numberBuffer[32];
+        String number = format_number(numberBuffer, sizeof(numberBuffer), value);
+        json_separator(writer);
+        output_fmt(writer->buffer, "\"%s\":%.*s", name, STR_FMT(number));
+    }
+    else
+    {
+        writer->section = string(name);
+        begin_record(writer);
+        write_number(writer, field, value);
+        end_record(writer);
+    }
+}
+
+internal void
+write_plan_node(Calculator *calculator, RecordWriter *writer, PlanNode *node, b32 isAlternate = false)
+{
+    begin_record(writer);
+    switch (node->kind)
+    {
+        case PlanNode_Recipe:
+        {
+            Recipe *recipe = node->recipe;
+            write_string(writer, Field_Kind, isAlternate ? static_string("alternate") : static_string("recipe"));
+            write_string(writer, Field_Item, node->item->name);
+            write_rate(writer, Field_PerMinute, node->itemsPerMinute);
+            if (node->overproduced)
+            {
+                write_rate(writer, Field_ProducedPerMinute, node->producedRatio * recipe->output.itemsPerMinute);
+            }
+            if (!is_zero(node->usedExtraPerMinute))
+            {
+                write_rate(writer, Field_UsedExtraPerMinute, node->usedExtraPerMinute);
+            }
+            if (recipe->building)
+            {
+                write_string(writer, Field_Building, string_from_building(calculator, recipe->building));
+                write_rate(writer, Field_Buildings, node->producedRatio);
+                write_number(writer, Field_PowerMW,
+                             to_f64(node->producedRatio) * calculator->buildings[recipe->building].power);
+            }
+            if (writer->beltTier)
+            {
+                write_number(writer, Field_Belts,
+                             get_belt_count(writer->beltTier, node->producedRatio * recipe->output.itemsPerMinute));
+            }
+
+            if (node->firstInput)
+            {
+                begin_list(writer, "inputs");
+                for (PlanNode *input = node->firstInput; input; input = input->next)
+                {
+                    write_plan_node(calculator, writer, input);
+                }
+                end_list(writer);
+            }
+            if (node->firstAlternate)
+            {
+                begin_list(writer, "alternates");
+                for (PlanNode *alternate = node->firstAlternate; alternate; alternate = alternate->next)
+                {
+                    write_plan_node(calculator, writer, alternate, true);
+                }
+                end_list(writer);
+            }
+        } break;
+
+        case PlanNode_Resource:
+        {
+            write_string(writer, Field_Kind, static_string("resource"));
+            write_string(writer, Field_Item, node->item->name);
+            write_rate(writer, Field_PerMinute, node->itemsPerMinute);
+            if (writer->beltTier)
+            {
+                write_number(writer, Field_Belts, get_belt_count(writer->beltTier, node->itemsPerMinute));
+            }
+        } break;
+
+        case PlanNode_AlreadyProduced:
+        {
+            write_string(writer, Field_Kind, static_string("already_produced"));
+            write_string(writer, Field_Item, node->item->name);
+        } break;
+
+        case PlanNode_Loop:
+        {
+            write_string(writer, Field_Kind, static_string("loop"));
+            write_string(writer, Field_Item, node->item->name);
+            write_rate(writer, Field_PerMinute, node->itemsPerMinute);
+        } break;
+
+        INVALID_DEFAULT_CASE;
+    }
+    end_record(writer);
+}
+
+internal void
+write_buildings(Calculator *calculator, RecordWriter *writer, CostTest *cost)
+{
+    i_expect(calculator->buildingCount <= array_count(cost->buildingCounts));
+    f64 totalPower = 0.0;
+    begin_list(writer, "buildings");
+    for (u32 idx = 1; idx < calculator->buildingCount; ++idx)
+    {
+        Rate value = cost->buildingCounts[idx];
+        if (!is_zero(value))
+        {
+            f64 powerUsage = to_f64(value) * calculator->buildings[idx].power;
+            begin_record(writer);
+            write_string(writer, Field_Building, string_from_building(calculator, idx));
+            write_rate(writer, Field_Buildings, value);
+            write_number(writer, Field_PowerMW, powerUsage);
+            end_record(writer);
+            totalPower += powerUsage;
+        }
+    }
+    end_list(writer);
+    write_summary(writer, "total_power", Field_PowerMW, totalPower);
+}
+
+// NOTE(michiel): The structured version of print_cost
+internal void
+write_cost(Calculator *calculator, RecordWriter *writer, CostTest *cost)
+{
+    begin_list(writer, "consumed");
+    for (u32 consumeIdx = 0; consumeIdx < cost->consumeCount; ++consumeIdx)
+    {
+        u32 itemId = cost->consumeOrder[consumeIdx];
+        begin_record(writer);
+        write_string(writer, Field_Item, calculator->itemNames[itemId]);
+        write_rate(writer, Field_PerMinute, cost->consumed[itemId]);
+        end_record(writer);
+    }
+    end_list(writer);
+
+    begin_list(writer, "produced");
+    for (u32 produceIdx = 0; produceIdx < cost->produceCount; ++produceIdx)
+    {
+        u32 itemId = cost->produceOrder[produceIdx];
+        begin_record(writer);
+        write_string(writer, Field_Item, calculator->itemNames[itemId]);
+        write_rate(writer, Field_PerMinute, cost->produced[itemId]);
+        end_record(writer);
+    }
+    end_list(writer);
+
+    write_buildings(calculator, writer, cost);
+}
+
+// NOTE(michiel): The structured version of print_total_production
+internal void
+write_total_production(Calculator *calculator, RecordWriter *writer, CostTest *cost, u32 targetCount,
+                       ProductionTarget *targets, u16 *choices = 0)
+{
+    begin_list(writer, "totals");
+    for (u32 productionIdx = 0; productionIdx < cost->produceCount; ++productionIdx)
+    {
+        u32 itemId = cost->produceOrder[productionIdx];
+        Rate produced = cost->produced[itemId];
+
+        RecipeList productionRecipes = get_recipes(calculator, itemId);
+
+        begin_record(writer);
+        b32 isIntermediate = (cost->consumeSlots[itemId] != 0) && !is_production_target(targetCount, targets, itemId);
+        if (!productionRecipes.count) {
+            write_string(writer, Field_Kind, static_string("byproduct"));
+        } else {
+            write_string(writer, Field_Kind, isIntermediate ? static_string("intermediate") : static_string("product"));
+        }
+        write_string(writer, Field_Item, calculator->itemNames[itemId]);
+        write_rate(writer, Field_PerMinute, produced);
+        if (productionRecipes.count)
+        {
+            Recipe *productionRecipe = get_chosen_recipe(productionRecipes, choices, itemId);
+            write_rate(writer, Field_Buildings, produced / productionRecipe->output.itemsPerMinute);
+        }
+        if (isIntermediate && (cost->consumed[itemId] < produced))
+        {
+            write_rate(writer, Field_ExtraPerMinute, produced - cost->consumed[itemId]);
+        }
+        end_record(writer);
+    }
+
+    for (u32 consumptionIdx = 0; consumptionIdx < cost->consumeCount; ++consumptionIdx)
+    {
+        u32 itemId = cost->consumeOrder[consumptionIdx];
+        if (!cost->produceSlots[itemId])
+        {
+            begin_record(writer);
+            write_string(writer, Field_Kind, static_string("resource"));
+            write_string(writer, Field_Item, calculator->itemNames[itemId]);
+            write_rate(writer, Field_PerMinute, cost->consumed[itemId]);
+            end_record(writer);
+        }
+    }
+    end_list(writer);
+
+    write_buildings(calculator, writer, cost);
+}
@@ -0,0 +1,340 @@
+// NOTE(michiel): Serves queries over a unix domain socket, so the recipe book, the recipe index and the memoized unit
+// costs are built once instead of once per process. A client sends query lines (the same as a batch line, flags
+// included, or a ':' session line, see session.cpp) and gets one reply per line, in order: 'OK <size>\n' followed by size bytes of output, or
+// 'ERROR <size>\n' followed by the error text. Any number of clients can be connected, they are served by a single
+// threaded poll loop. The queries share the calculator, its scratch costs and the query arena, and take well under a
+// millisecond, so running them one at a time is both the simplest and the fastest option.
+
+#if _MSC_VER
+
+internal b32
+run_server(Calculator *calculator, TextOutput output, CostTest *cost, QueryOptions *defaults, const char *socketFile)
+{
+    fprintf(stderr, "Serving '%s' needs unix domain sockets, which this build does not support\n", socketFile);
+    return false;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_SERVER_CLIENTS    256
+#define MAX_SERVER_LINE_SIZE  (64 * 1024)
+
+struct ServerClient
+{
+    s32 socket;
+    b32 closing;      // NOTE(michiel): Set when the client hung up, the pending replies are still sent
+    PlanSession *session;
+    OutputBuffer input;
+    OutputBuffer replies;
+    umm repliesSent;
+};
+
+global volatile sig_atomic_t gServerRunning;
+
+internal void
+stop_server(int signalNumber)
+{
+    gServerRunning = false;
+}
+
+internal b32
+set_nonblocking(s32 socket)
+{
+    s32 flags = fcntl(socket, F_GETFL, 0);
+    return (flags >= 0) && (fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0);
+}
+
+// NOTE(michiel): Computes the unit costs of all default recipes up front, so the first queries are as fast as the rest.
+// The ones that run into a loop that uses up more than it makes can not be computed, queries report those.
+internal void
+warm_unit_costs(Calculator *calculator)
+{
+    RecipeLoops *loops = get_recipe_loops(calculator);
+    for (u32 itemId = 1; itemId < calculator->itemCount; ++itemId)
+    {
+        RecipeList producers = get_recipes(calculator, itemId);
+        if (producers.count && !get_blocking_loop(loops, producers.recipes[0]))
+        {
+            get_unit_cost(calculator, producers.recipes[0]);
+        }
+    }
+}
+
+internal void
+answer_query(Calculator *calculator, TextOutput output, CostTest *cost, QueryOptions *defaults, String line,
+             ServerClient *client)
+{
+    b32 succeeded = false;
+    if (line.size && (line.data[0] == ':'))
+    {
+        // NOTE(michiel): Every client gets its own session, so edits of one planner do not show up in another
+        if (!client->session)
+        {
+            client->session = allocate_session(calculator->itemCount);
+        }
+        succeeded = run_session_line(calculator, output, client->session, defaults, line);
+    }
+    else
+    {
+        QueryOptions options = *defaults;
+        QueryTarget targets[MAX_QUERY_TARGETS];
+        u32 targetCount = 0;
+        succeeded = parse_query_line(output, line, &options, &targetCount, targets) &&
+            run_query(calculator, output, cost, &options, targetCount, targets);
+    }
+    succeeded = succeeded && (output.errors->size == 0);
+
+    OutputBuffer *replies = &client->replies;
+    OutputBuffer *answer = succeeded ? output.buffer : output.errors;
+    output_fmt(replies, "%s %lu\n", succeeded ? "OK" : "ERROR", (unsigned long)answer->size);
+    output_string(replies, {answer->size, answer->data});
+    output.buffer->size = 0;
+    output.errors->size = 0;
+}
+
+// NOTE(michiel): Answers every complete line in the input and keeps the unfinished rest for the next read
+internal void
+answer_client_lines(Calculator *calculator, TextOutput output, CostTest *cost, QueryOptions *defaults,
+                    ServerClient *client)
+{
+    OutputBuffer *input = &client->input;
+    umm lineStart = 0;
+    for (umm idx = 0; idx < input->size; ++idx)
+    {
+        if (input->data[idx] == '\n')
+        {
+            String line = {idx - lineStart, input->data + lineStart};
+            while (line.size && (line.data[line.size - 1] == '\r'))
+            {
+                --line.size;
+            }
+            answer_query(calculator, output, cost, defaults, trim_spaces(line), client);
+            lineStart = idx + 1;
+        }
+    }
+
+    if (lineStart)
+    {
+        memmove(input->data, input->data + lineStart, input->size - lineStart);
+        input->size -= lineStart;
+    }
+    if (input->size > MAX_SERVER_LINE_SIZE)
+    {
+        fprintf(stderr, "Dropping a client that sent a line of more than %u bytes\n", MAX_SERVER_LINE_SIZE);
+        client->closing = true;
+        client->replies.size = client->repliesSent;
+    }
+}
+
+internal void
+read_client(Calculator *calculator, TextOutput output, CostTest *cost, QueryOptions *defaults, ServerClient *client)
+{
+    for (;;)
+    {
+        reserve_output(&client->input, 4096);
+        ssize_t readSize = read(client->socket, client->input.data + client->input.size,
+                                client->input.maxSize - client->input.size);
+        if (readSize > 0)
+        {
+            client->input.size += readSize;
+        }
+        else
+        {
+            if ((readSize == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+            {
+                client->closing = true;
+            }
+            if ((readSize == 0) || (errno != EINTR))
+            {
+                break;
+            }
+        }
+    }
+    answer_client_lines(calculator, output, cost, defaults, client);
+}
+
+// NOTE(michiel): Returns false if the client is done, either because it hung up or because writing failed
+internal b32
+write_client(ServerClient *client)
+{
+    b32 result = true;
+    while (client->repliesSent < client->replies.size)
+    {
+        ssize_t written = write(client->socket, client->replies.data + client->repliesSent,
+                                client->replies.size - client->repliesSent);
+        if (written > 0)
+        {
+            client->repliesSent += written;
+        }
+        else if ((written < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        else
+        {
+            if ((written == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+            {
+                result = false;
+            }
+            break;
+        }
+    }
+
+    if (client->repliesSent == client->replies.size)
+    {
+        client->replies.size = 0;
+        client->repliesSent = 0;
+        if (client->closing)
+        {
+            result = false;
+        }
+    }
+    return result;
+}
+
+internal b32
+run_server(Calculator *calculator, TextOutput output, CostTest *cost, QueryOptions *defaults, const char *socketFile)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socketFile) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path '%s' is too long\n", socketFile);
+        return false;
+    }
+    strcpy(address.sun_path, socketFile);
+
+    s32 listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        fprintf(stderr, "Could not create a socket: %s\n", strerror(errno));
+        return false;
+    }
+
+    // NOTE(michiel): A socket file left behind by an earlier server that did not shut down cleanly is replaced
+    unlink(socketFile);
+    if ((bind(listener, (sockaddr *)&address, sizeof(address)) != 0) || (listen(listener, 128) != 0) ||
+        !set_nonblocking(listener))
+    {
+        fprintf(stderr, "Could not listen on '%s': %s\n", socketFile, strerror(errno));
+        close(listener);
+        return false;
+    }
+
+    struct sigaction stopAction = {};
+    stopAction.sa_handler = stop_server;
+    sigaction(SIGINT, &stopAction, 0);
+    sigaction(SIGTERM, &stopAction, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    warm_unit_costs(calculator);
+    fprintf(stderr, "Serving queries on '%s'\n", socketFile);
+
+    u32 clientCount = 0;
+    ServerClient *clients = (ServerClient *)calloc(MAX_SERVER_CLIENTS, sizeof(ServerClient));
+    pollfd *polls = (pollfd *)calloc(MAX_SERVER_CLIENTS + 1, sizeof(pollfd));
+
+    gServerRunning = true;
+    while (gServerRunning)
+    {
+        polls[0].fd = listener;
+        polls[0].events = POLLIN;
+        polls[0].revents = 0;
+        for (u32 clientIdx = 0; clientIdx < clientCount; ++clientIdx)
+        {
+            ServerClient *client = clients + clientIdx;
+            pollfd *clientPoll = polls + clientIdx + 1;
+            clientPoll->fd = client->socket;
+            clientPoll->events = (client->closing ? 0 : POLLIN) | (client->replies.size ? POLLOUT : 0);
+            clientPoll->revents = 0;
+        }
+
+        if (poll(polls, clientCount + 1, -1) < 0)
+        {
+            if (errno != EINTR)
+            {
+                fprintf(stderr, "Polling the clients failed: %s\n", strerror(errno));
+                gServerRunning = false;
+            }
+            continue;
+        }
+
+        u32 polledCount = clientCount;
+        for (u32 clientIdx = 0; clientIdx < polledCount; ++clientIdx)
+        {
+            ServerClient *client = clients + clientIdx;
+            s16 events = polls[clientIdx + 1].revents;
+            if (events & (POLLIN | POLLHUP | POLLERR))
+            {
+                read_client(calculator, output, cost, defaults, client);
+            }
+            if (!write_client(client))
+            {
+                close(client->socket);
+                free(client->input.data);
+                free(client->replies.data);
+                free_session(client->session);
+                *client = {};
+                client->socket = -1;
+            }
+        }
+
+        // NOTE(michiel): Compact after the loop, the poll entries still line up with the clients inside of it
+        u32 keptCount = 0;
+        for (u32 clientIdx = 0; clientIdx < clientCount; ++clientIdx)
+        {
+            if (clients[clientIdx].socket >= 0)
+            {
+                clients[keptCount++] = clients[clientIdx];
+            }
+        }
+        clientCount = keptCount;
+
+        if (polls[0].revents & POLLIN)
+        {
+            for (;;)
+            {
+                s32 clientSocket = accept(listener, 0, 0);
+                if (clientSocket < 0)
+                {
+                    break;
+                }
+                if ((clientCount < MAX_SERVER_CLIENTS) && set_nonblocking(clientSocket))
+                {
+                    ServerClient *client = clients + clientCount++;
+                    *client = {};
+                    client->socket = clientSocket;
+                }
+                else
+                {
+                    close(clientSocket);
+                }
+            }
+        }
+    }
+
+    for (u32 clientIdx = 0; clientIdx < clientCount; ++clientIdx)
+    {
+        close(clients[clientIdx].socket);
+        free(clients[clientIdx].input.data);
+        free(clients[clientIdx].replies.data);
+        free_session(clients[clientIdx].session);
+    }
+    free(clients);
+    free(polls);
+    close(listener);
+    unlink(socketFile);
+    fprintf(stderr, "Stopped serving '%s'\n", socketFile);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,415 @@
+// NOTE(michiel): A plan session keeps a solved plan around and updates it in place. The plan is the same cost as
+// calc_total_production builds (add_recipe_cost for every recipe in the tree), but with a recipe choice per item.
+// Everything in it is linear in the rates, so every edit is applied as a delta:
+//  - changing the rate of the only target rescales the whole cost,
+//  - changing the rate of one of several targets pushes the difference through the subtree of that target,
+//  - picking another recipe for an item takes the current demand of that item out through the subtree of the old
+//    recipe and puts it back in through the subtree of the new one. Nothing outside of those subtrees is touched,
+//  - unless the item is in a loop before or after the choice, then the plan is solved again from the targets.
+// With exact rates the result is identical to solving the edited plan from scratch.
+//
+// Session lines start with a ':'
+//   :target <recipe name> [items per minute]   set the rate of a target, adds it if needed (0 removes it)
+//   :use <item name> <n>                        make recipe n (0 is the default) the recipe for the item
+//   :show [flags]                               print the totals of the plan, -j and -c work as usual
+//   :clear                                      drop all targets and recipe choices
+//   :find <text>                                up to 10 item names for autocompletion, see search.cpp
+
+struct PlanSession
+{
+    u32 itemCount;
+    CostTest *cost;
+    u16 *choices;       // NOTE(michiel): The picked recipe index + 1 per item, 0 for the default recipe
+    Rate *demanded;     // NOTE(michiel): Per item, what the picked recipe of the item produces in this plan
+    RecipeLoops *loops; // NOTE(michiel): The loops of the picked recipes, found again after a choice changes
+
+    u32 targetCount;
+    ProductionTarget targets[MAX_QUERY_TARGETS];
+};
+
+internal PlanSession *
+allocate_session(u32 itemCount)
+{
+    PlanSession *result = (PlanSession *)calloc(1, sizeof(PlanSession));
+    result->itemCount = itemCount;
+    result->cost = allocate_cost(itemCount);
+    result->choices = (u16 *)calloc(itemCount, sizeof(u16));
+    result->demanded = (Rate *)calloc(itemCount, sizeof(Rate));
+    for (u32 itemId = 0; itemId < itemCount; ++itemId)
+    {
+        result->demanded[itemId] = make_rate(0);
+    }
+    return result;
+}
+
+internal void
+free_session(PlanSession *session)
+{
+    if (session)
+    {
+        free(session->cost);
+        free(session->choices);
+        free(session->demanded);
+        free_recipe_loops(session->loops);
+        free(session);
+    }
+}
+
+internal Recipe *
+get_session_recipe(Calculator *calculator, PlanSession *session, u32 itemId)
+{
+    Recipe *result = 0;
+    RecipeList recipes = get_recipes(calculator, itemId);
+    if (recipes.count)
+    {
+        u32 choice = session->choices[itemId] ? session->choices[itemId] - 1 : 0;
+        result = recipes.recipes[choice];
+    }
+    return result;
+}
+
+internal RecipeLoops *
+get_session_loops(Calculator *calculator, PlanSession *session)
+{
+    if (!session->loops)
+    {
+        session->loops = find_recipe_loops(calculator, session->choices);
+    }
+    return session->loops;
+}
+
+// NOTE(michiel): Adds deltaPerMinute of the item to the plan, with all of its inputs. An item in a loop moves the
+// whole loop to its new steady state, the inputs from outside of the loop get their deltas after that.
+internal void
+push_session_delta(Calculator *calculator, PlanSession *session, u32 itemId, Rate deltaPerMinute)
+{
+    Recipe *recipe = get_session_recipe(calculator, session, itemId);
+    i_expect(recipe);
+    RecipeLoops *loops = get_session_loops(calculator, session);
+    RecipeLoop *loop = get_item_loop(loops, itemId);
+    i_expect(!loop || loop->productive);
+
+    u32 memberCount = loop ? loop->memberCount : 1;
+    for (u32 memberIdx = 0; memberIdx < memberCount; ++memberIdx)
+    {
+        Recipe *member = loop ? loop->recipes[memberIdx] : recipe;
+        Rate ratio = loop ? get_loop_ratio(loop, memberIdx, loops->memberSlots[itemId]) * deltaPerMinute :
+                            deltaPerMinute / recipe->output.itemsPerMinute;
+        session->demanded[member->output.id] += ratio * member->output.itemsPerMinute;
+
+        add_recipe_cost(session->cost, member, ratio);
+        for (u32 inputIdx = 0; inputIdx < member->inputCount; ++inputIdx)
+        {
+            Item *input = member->inputs + inputIdx;
+            if (get_recipes(calculator, input->id).count && (!loop || (get_item_loop(loops, input->id) != loop)))
+            {
+                push_session_delta(calculator, session, input->id, input->itemsPerMinute * ratio);
+            }
+        }
+    }
+}
+
+internal void
+scale_session(PlanSession *session, Rate factor)
+{
+    CostTest *cost = session->cost;
+    for (u32 consumeIdx = 0; consumeIdx < cost->consumeCount; ++consumeIdx)
+    {
+        u32 itemId = cost->consumeOrder[consumeIdx];
+        cost->consumed[itemId] = cost->consumed[itemId] * factor;
+    }
+    for (u32 produceIdx = 0; produceIdx < cost->produceCount; ++produceIdx)
+    {
+        // NOTE(michiel): Only produced items can have a demand
+        u32 itemId = cost->produceOrder[produceIdx];
+        cost->produced[itemId] = cost->produced[itemId] * factor;
+        session->demanded[itemId] = session->demanded[itemId] * factor;
+    }
+    for (u32 idx = 0; idx < array_count(cost->buildingCounts); ++idx)
+    {
+        cost->buildingCounts[idx] = cost->buildingCounts[idx] * factor;
+    }
+}
+
+// NOTE(michiel): A loop that comes or goes with a recipe choice changes the demand of all of its items at once, so the
+// plan is solved again from its targets
+internal void
+rebuild_session(Calculator *calculator, PlanSession *session)
+{
+    reset_cost(session->cost);
+    for (u32 itemId = 0; itemId < session->itemCount; ++itemId)
+    {
+        session->demanded[itemId] = make_rate(0);
+    }
+    for (u32 targetIdx = 0; targetIdx < session->targetCount; ++targetIdx)
+    {
+        ProductionTarget *target = session->targets + targetIdx;
+        push_session_delta(calculator, session, target->itemId, target->itemsPerMinute);
+    }
+    remove_zero_entries(session->cost);
+}
+
+internal b32
+set_session_target(Calculator *calculator, TextOutput output, PlanSession *session, u32 itemId, Rate itemsPerMinute)
+{
+    b32 result = true;
+    ProductionTarget *target = 0;
+    for (u32 targetIdx = 0; targetIdx < session->targetCount; ++targetIdx)
+    {
+        if (session->targets[targetIdx].itemId == itemId)
+        {
+            target = session->targets + targetIdx;
+            break;
+        }
+    }
+
+    Recipe *recipe = get_session_recipe(calculator, session, itemId);
+    RecipeLoop *blocking = get_blocking_loop(get_session_loops(calculator, session), recipe);
+    if (blocking)
+    {
+        print_blocking_loop(calculator, output, recipe, blocking);
+        result = false;
+    }
+    else if (!target && (session->targetCount == array_count(session->targets)))
+    {
+        print_error(output, "A session can not have more than %u targets", MAX_QUERY_TARGETS);
+        result = false;
+    }
+    else
+    {
+        if (!target)
+        {
+            target = session->targets + session->targetCount++;
+            target->itemId = itemId;
+            target->itemsPerMinute = make_rate(0);
+        }
+
+        Rate delta = itemsPerMinute - target->itemsPerMinute;
+        if ((session->targetCount == 1) && !is_zero(target->itemsPerMinute))
+        {
+            scale_session(session, itemsPerMinute / target->itemsPerMinute);
+        }
+        else
+        {
+            push_session_delta(calculator, session, itemId, delta);
+        }
+        target->itemsPerMinute = itemsPerMinute;
+        remove_zero_entries(session->cost);
+
+        if (is_zero(itemsPerMinute))
+        {
+            *target = session->targets[--session->targetCount];
+        }
+    }
+    return result;
+}
+
+internal b32
+set_session_choice(Calculator *calculator, TextOutput output, PlanSession *session, u32 itemId, u32 recipeIndex)
+{
+    b32 result = true;
+    RecipeList recipes = get_recipes(calculator, itemId);
+    if (recipeIndex >= recipes.count)
+    {
+        print_error(output, "'%.*s' has %u recipes, there is no recipe %u", STR_FMT(calculator->itemNames[itemId]),
+                    recipes.count, recipeIndex);
+        result = false;
+    }
+    else
+    {
+        // NOTE(michiel): Only loops through the item itself can come or go with its recipe
+        u16 oldChoice = session->choices[itemId];
+        b32 wasInLoop = get_item_loop(get_session_loops(calculator, session), itemId) != 0;
+        session->choices[itemId] = (u16)(recipeIndex + 1);
+        RecipeLoops *newLoops = find_recipe_loops(calculator, session->choices);
+        RecipeLoop *newLoop = get_item_loop(newLoops, itemId);
+        RecipeLoop *blocking = get_blocking_loop(newLoops, recipes.recipes[recipeIndex]);
+        if (newLoop && !newLoop->productive)
+        {
+            print_error(output, "Recipe %u of '%.*s' closes a loop that uses up more than it makes", recipeIndex,
+                        STR_FMT(calculator->itemNames[itemId]));
+            session->choices[itemId] = oldChoice;
+            free_recipe_loops(newLoops);
+            result = false;
+        }
+        else if (blocking)
+        {
+            print_blocking_loop(calculator, output, recipes.recipes[recipeIndex], blocking);
+            session->choices[itemId] = oldChoice;
+            free_recipe_loops(newLoops);
+            result = false;
+        }
+        else if (wasInLoop || newLoop)
+        {
+            free_recipe_loops(session->loops);
+            session->loops = newLoops;
+            rebuild_session(calculator, session);
+        }
+        else
+        {
+            // NOTE(michiel): The loops stay the same, the demand goes out through the old recipe and back in through
+            // the new one
+            free_recipe_loops(newLoops);
+            if (!is_zero(session->demanded[itemId]))
+            {
+                Rate demand = session->demanded[itemId];
+                session->choices[itemId] = oldChoice;
+                push_session_delta(calculator, session, itemId, -demand);
+                session->choices[itemId] = (u16)(recipeIndex + 1);
+                push_session_delta(calculator, session, itemId, demand);
+                remove_zero_entries(session->cost);
+            }
+        }
+    }
+    return result;
+}
+
+internal void
+clear_session(PlanSession *session)
+{
+    reset_cost(session->cost);
+    free_recipe_loops(session->loops);
+    session->loops = 0;
+    for (u32 itemId = 0; itemId < session->itemCount; ++itemId)
+    {
+        session->choices[itemId] = 0;
+        session->demanded[itemId] = make_rate(0);
+    }
+    session->targetCount = 0;
+}
+
+internal void
+show_session(Calculator *calculator, TextOutput output, PlanSession *session, QueryOptions *options)
+{
+    if (options->format == Format_Text)
+    {
+        print_total_production(calculator, output, session->cost, session->targetCount, session->targets,
+                               session->choices);
+    }
+    else
+    {
+        RecordWriter *writer = push_record_writer(output, options->format, options->beltTier);
+
+        begin_document(writer);
+        begin_result(writer);
+        write_total_production(calculator, writer, session->cost, session->targetCount, session->targets,
+                               session->choices);
+        end_result(writer);
+        end_document(writer);
+    }
+    reset_arena(output.arena);
+}
+
+// NOTE(michiel): Splits '<name> [number]' like a query target, returns false if there is no number
+internal b32
+split_session_number(String *name, Rate *number)
+{
+    b32 result = false;
+    u32 lastSpace = name->size;
+    while (lastSpace && (name->data[lastSpace - 1] != ' '))
+    {
+        --lastSpace;
+    }
+    String lastWord = {name->size - lastSpace, name->data + lastSpace};
+    if (lastSpace && parse_rate_number(lastWord, number))
+    {
+        *name = trim_spaces({lastSpace, name->data});
+        result = true;
+    }
+    return result;
+}
+
+internal b32
+run_session_line(Calculator *calculator, TextOutput output, PlanSession *session, QueryOptions *defaults, String line)
+{
+    b32 result = true;
+    i_expect(line.size && (line.data[0] == ':'));
+    String rest = {line.size - 1, line.data + 1};
+    String command = split_off(&rest, static_string(" "));
+    rest = trim_spaces(rest);
+
+    if (command == static_string("target"))
+    {
+        Rate itemsPerMinute = make_rate(0);
+        b32 hasRate = split_session_number(&rest, &itemsPerMinute);
+        RecipeList producers = get_recipes(calculator, find_item(calculator, rest));
+        if (!producers.count)
+        {
+            print_suggestion(calculator, output, rest);
+            result = false;
+        }
+        else
+        {
+            u32 itemId = producers.recipes[0]->output.id;
+            if (!hasRate)
+            {
+                itemsPerMinute = get_session_recipe(calculator, session, itemId)->output.itemsPerMinute;
+            }
+            result = set_session_target(calculator, output, session, itemId, itemsPerMinute);
+        }
+    }
+    else if (command == static_string("use"))
+    {
+        Rate recipeIndex = make_rate(0);
+        if (!split_session_number(&rest, &recipeIndex) || !is_exact(recipeIndex) || (recipeIndex.denominator != 1) ||
+            (recipeIndex.numerator < 0))
+        {
+            print_error(output, "Expected ':use <item name> <recipe index>', got '%.*s'", STR_FMT(line));
+            result = false;
+        }
+        else
+        {
+            u32 itemId = find_item(calculator, rest);
+            if (!get_recipes(calculator, itemId).count)
+            {
+                print_suggestion(calculator, output, rest);
+                result = false;
+            }
+            else
+            {
+                result = set_session_choice(calculator, output, session, itemId, (u32)recipeIndex.numerator);
+            }
+        }
+    }
+    else if (command == static_string("show"))
+    {
+        QueryOptions options = *defaults;
+        while (rest.size)
+        {
+            String flag = split_off(&rest, static_string(" "));
+            char flagBuffer[8] = {};
+            memcpy(flagBuffer, flag.data, flag.size < sizeof(flagBuffer) ? flag.size : sizeof(flagBuffer) - 1);
+            if ((flag.size < 2) || (flag.data[0] != '-') || !parse_query_flag(&options, flagBuffer))
+            {
+                print_error(output, "Unknown flag '%.*s' in '%.*s'", STR_FMT(flag), STR_FMT(line));
+                result = false;
+                break;
+            }
+            rest = trim_spaces(rest);
+        }
+        if (result)
+        {
+            show_session(calculator, output, session, &options);
+        }
+    }
+    else if ((command == static_string("clear")) && !rest.size)
+    {
+        clear_session(session);
+    }
+    else if (command == static_string("find"))
+    {
+        u32 itemIds[MAX_FIND_RESULTS];
+        u32 itemCount = find_item_names(calculator, rest, MAX_FIND_RESULTS, itemIds);
+        for (u32 itemIdx = 0; itemIdx < itemCount; ++itemIdx)
+        {
+            print_line(output, "%.*s", STR_FMT(calculator->itemNames[itemIds[itemIdx]]));
+        }
+    }
+    else
+    {
+        print_error(output, "Unknown session command '%.*s', expected :target, :use, :show, :clear or :find",
+                    STR_FMT(line));
+        result = false;
+    }
+    return result;
+}
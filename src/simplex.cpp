@@ -0,0 +1,406 @@
+// NOTE(michiel): Dense two-phase simplex. Minimizes objective * x subject to the added constraints and x >= 0.
+// The calculator only hands it the items and recipes reachable from a query, so the tableau stays small.
+
+enum ConstraintKind
+{
+    Constraint_LessEqual,
+    Constraint_GreaterEqual,
+    Constraint_Equal,
+};
+
+enum LinearProgramResult
+{
+    LinearProgram_Optimal,
+    LinearProgram_Infeasible,
+    LinearProgram_Unbounded,
+    LinearProgram_IterationLimit, // NOTE(michiel): Gave up after SIMPLEX_PIVOTS_PER_SIZE * (rows + columns) pivots
+};
+
+struct LinearProgram
+{
+    u32 variableCount;
+    u32 maxConstraintCount;
+    u32 constraintCount;
+
+    f64 *objective;        // NOTE(michiel): variableCount entries
+    f64 *coefficients;     // NOTE(michiel): maxConstraintCount rows of variableCount entries
+    ConstraintKind *kinds;
+    f64 *rightHandSides;
+
+    f64 *solution;         // NOTE(michiel): variableCount entries, valid after an optimal solve
+    f64 *duals;            // NOTE(michiel): constraintCount entries, the change of the objective per unit of right
+                           // hand side, valid after an optimal solve
+    f64 objectiveValue;
+    u32 iterationCount;
+};
+
+#define SIMPLEX_EPSILON      1.0e-9
+#define SIMPLEX_PERTURBATION 1.0e-6
+// NOTE(michiel): Both phases together rarely take more pivots than rows + columns, this cap is only there so a program
+// that keeps cycling (round off can undo the perturbation) fails instead of hanging the query
+#define SIMPLEX_PIVOTS_PER_SIZE 50
+
+internal void
+init_linear_program(LinearProgram *program, u32 variableCount, u32 maxConstraintCount)
+{
+    *program = {};
+    program->variableCount = variableCount;
+    program->maxConstraintCount = maxConstraintCount;
+    program->objective = (f64 *)calloc(variableCount, sizeof(f64));
+    program->coefficients = (f64 *)calloc((umm)variableCount * maxConstraintCount, sizeof(f64));
+    program->kinds = (ConstraintKind *)calloc(maxConstraintCount, sizeof(ConstraintKind));
+    program->rightHandSides = (f64 *)calloc(maxConstraintCount, sizeof(f64));
+    program->solution = (f64 *)calloc(variableCount, sizeof(f64));
+    program->duals = (f64 *)calloc(maxConstraintCount ? maxConstraintCount : 1, sizeof(f64));
+}
+
+internal void
+free_linear_program(LinearProgram *program)
+{
+    free(program->objective);
+    free(program->coefficients);
+    free(program->kinds);
+    free(program->rightHandSides);
+    free(program->solution);
+    free(program->duals);
+    *program = {};
+}
+
+// NOTE(michiel): Returns the row to fill in, all entries start at zero.
+internal f64 *
+add_constraint(LinearProgram *program, ConstraintKind kind, f64 rightHandSide)
+{
+    i_expect(program->constraintCount < program->maxConstraintCount);
+    u32 rowIdx = program->constraintCount++;
+    program->kinds[rowIdx] = kind;
+    program->rightHandSides[rowIdx] = rightHandSide;
+    return program->coefficients + (umm)rowIdx * program->variableCount;
+}
+
+// NOTE(michiel): Every row ends with two right hand side columns, the one the ratio test uses (which gets perturbed
+// when the pivots stall on a degenerate vertex) and the exact one that the solution is read from. Both are pivoted
+// along with the rest of the row.
+struct SimplexTableau
+{
+    u32 rowCount;
+    u32 columnCount;    // NOTE(michiel): Excluding the right hand side columns
+    u32 stride;
+    f64 *values;        // NOTE(michiel): rowCount constraint rows + 1 cost row
+    u32 *basis;
+    u32 firstArtificial;
+    b32 perturbed;
+};
+
+internal void
+simplex_pivot(SimplexTableau *tableau, u32 pivotRow, u32 pivotColumn)
+{
+    f64 *row = tableau->values + (umm)pivotRow * tableau->stride;
+    f64 invPivot = 1.0 / row[pivotColumn];
+    for (u32 column = 0; column < tableau->stride; ++column)
+    {
+        row[column] *= invPivot;
+    }
+    row[pivotColumn] = 1.0;
+
+    for (u32 rowIdx = 0; rowIdx <= tableau->rowCount; ++rowIdx)
+    {
+        if (rowIdx != pivotRow)
+        {
+            f64 *other = tableau->values + (umm)rowIdx * tableau->stride;
+            f64 factor = other[pivotColumn];
+            if (factor != 0.0)
+            {
+                for (u32 column = 0; column < tableau->stride; ++column)
+                {
+                    other[column] -= factor * row[column];
+                }
+                other[pivotColumn] = 0.0;
+            }
+        }
+    }
+
+    tableau->basis[pivotRow] = pivotColumn;
+}
+
+// NOTE(michiel): Runs the simplex iterations on the cost row, only columns below columnLimit may enter the basis.
+// Stops with LinearProgram_IterationLimit once iterationCount reaches maxIterations.
+internal LinearProgramResult
+simplex_iterate(SimplexTableau *tableau, u32 columnLimit, u32 *iterationCount, u32 maxIterations)
+{
+    LinearProgramResult result = LinearProgram_Optimal;
+    f64 *costRow = tableau->values + (umm)tableau->rowCount * tableau->stride;
+    u32 rhsColumn = tableau->columnCount;
+
+    // NOTE(michiel): Dantzig's rule. Degenerate vertices (lots of rows at zero, every item without demand is one) can
+    // make it cycle. So if we keep pivoting without making progress, every row gets a different tiny bit added to the
+    // right hand side, which takes the ties away. The exact right hand side goes along, so the final basis still
+    // gives the exact solution.
+    u32 degenerateCount = 0;
+    for (;;)
+    {
+        if ((degenerateCount > 64) && !tableau->perturbed)
+        {
+            tableau->perturbed = true;
+            u32 random = 0x5A71C0DE;
+            for (u32 rowIdx = 0; rowIdx < tableau->rowCount; ++rowIdx)
+            {
+                random ^= random << 13;
+                random ^= random >> 17;
+                random ^= random << 5;
+                f64 *row = tableau->values + (umm)rowIdx * tableau->stride;
+                row[rhsColumn] += SIMPLEX_PERTURBATION * (1.0 + (f64)(random & 0xFFFF) / 65536.0);
+            }
+        }
+
+        u32 enterColumn = columnLimit;
+        f64 mostNegative = -SIMPLEX_EPSILON;
+        for (u32 column = 0; column < columnLimit; ++column)
+        {
+            if (costRow[column] < mostNegative)
+            {
+                enterColumn = column;
+                mostNegative = costRow[column];
+            }
+        }
+
+        if (enterColumn == columnLimit)
+        {
+            break;
+        }
+
+        if (*iterationCount >= maxIterations)
+        {
+            result = LinearProgram_IterationLimit;
+            break;
+        }
+
+        // NOTE(michiel): Harris' ratio test, first find the smallest ratio with a bit of slack on every row, then take
+        // the largest pivot of the rows that fit under it. Small pivots are where the round off comes from.
+        f64 maxRatio = HUGE_VAL;
+        for (u32 rowIdx = 0; rowIdx < tableau->rowCount; ++rowIdx)
+        {
+            f64 *row = tableau->values + (umm)rowIdx * tableau->stride;
+            f64 pivot = row[enterColumn];
+            if ((pivot > SIMPLEX_EPSILON) && ((row[rhsColumn] + SIMPLEX_EPSILON) / pivot < maxRatio))
+            {
+                maxRatio = (row[rhsColumn] + SIMPLEX_EPSILON) / pivot;
+            }
+        }
+
+        u32 leaveRow = tableau->rowCount;
+        f64 bestRatio = 0.0;
+        f64 bestPivot = 0.0;
+        for (u32 rowIdx = 0; rowIdx < tableau->rowCount; ++rowIdx)
+        {
+            f64 *row = tableau->values + (umm)rowIdx * tableau->stride;
+            f64 pivot = row[enterColumn];
+            if ((pivot > SIMPLEX_EPSILON) && (row[rhsColumn] / pivot <= maxRatio) && (pivot > bestPivot))
+            {
+                leaveRow = rowIdx;
+                bestRatio = row[rhsColumn] / pivot;
+                bestPivot = pivot;
+            }
+        }
+
+        if (leaveRow == tableau->rowCount)
+        {
+            result = LinearProgram_Unbounded;
+            break;
+        }
+
+        if (bestRatio < SIMPLEX_EPSILON) {
+            ++degenerateCount;
+        } else {
+            degenerateCount = 0;
+        }
+
+        simplex_pivot(tableau, leaveRow, enterColumn);
+        ++(*iterationCount);
+    }
+
+    return result;
+}
+
+internal LinearProgramResult
+solve_linear_program(LinearProgram *program)
+{
+    LinearProgramResult result = LinearProgram_Optimal;
+
+    u32 rowCount = program->constraintCount;
+    u32 variableCount = program->variableCount;
+
+    // NOTE(michiel): Normalize to non-negative right hand sides, then every inequality gets a slack column and every
+    // row without a slack that can start in the basis gets an artificial column.
+    u32 slackCount = 0;
+    u32 artificialCount = 0;
+    for (u32 rowIdx = 0; rowIdx < rowCount; ++rowIdx)
+    {
+        ConstraintKind kind = program->kinds[rowIdx];
+        if (program->rightHandSides[rowIdx] < 0.0)
+        {
+            if (kind == Constraint_LessEqual) {
+                kind = Constraint_GreaterEqual;
+            } else if (kind == Constraint_GreaterEqual) {
+                kind = Constraint_LessEqual;
+            }
+        }
+        if (kind != Constraint_Equal) {
+            ++slackCount;
+        }
+        if (kind != Constraint_LessEqual) {
+            ++artificialCount;
+        }
+    }
+
+    SimplexTableau tableau = {};
+    tableau.rowCount = rowCount;
+    tableau.columnCount = variableCount + slackCount + artificialCount;
+    tableau.stride = tableau.columnCount + 2;
+    tableau.values = (f64 *)calloc((umm)(rowCount + 1) * tableau.stride, sizeof(f64));
+    tableau.basis = (u32 *)calloc(rowCount ? rowCount : 1, sizeof(u32));
+    tableau.firstArtificial = variableCount + slackCount;
+
+    // NOTE(michiel): Per row the column that starts as its unit vector, the cost row ends up with its dual there
+    u32 *dualColumns = (u32 *)malloc(sizeof(u32) * (rowCount ? rowCount : 1));
+    f64 *dualFactors = (f64 *)malloc(sizeof(f64) * (rowCount ? rowCount : 1));
+
+    u32 slackColumn = variableCount;
+    u32 artificialColumn = tableau.firstArtificial;
+    f64 *costRow = tableau.values + (umm)rowCount * tableau.stride;
+    for (u32 rowIdx = 0; rowIdx < rowCount; ++rowIdx)
+    {
+        f64 *source = program->coefficients + (umm)rowIdx * variableCount;
+        f64 *row = tableau.values + (umm)rowIdx * tableau.stride;
+        f64 sign = (program->rightHandSides[rowIdx] < 0.0) ? -1.0 : 1.0;
+        ConstraintKind kind = program->kinds[rowIdx];
+        if (sign < 0.0)
+        {
+            if (kind == Constraint_LessEqual) {
+                kind = Constraint_GreaterEqual;
+            } else if (kind == Constraint_GreaterEqual) {
+                kind = Constraint_LessEqual;
+            }
+        }
+
+        for (u32 column = 0; column < variableCount; ++column)
+        {
+            row[column] = sign * source[column];
+        }
+        row[tableau.columnCount] = sign * program->rightHandSides[rowIdx];
+        row[tableau.columnCount + 1] = row[tableau.columnCount];
+
+        dualFactors[rowIdx] = -sign;
+        if (kind == Constraint_LessEqual)
+        {
+            row[slackColumn] = 1.0;
+            dualColumns[rowIdx] = slackColumn;
+            tableau.basis[rowIdx] = slackColumn++;
+        }
+        else
+        {
+            if (kind == Constraint_GreaterEqual)
+            {
+                row[slackColumn++] = -1.0;
+            }
+            row[artificialColumn] = 1.0;
+            dualColumns[rowIdx] = artificialColumn;
+            tableau.basis[rowIdx] = artificialColumn++;
+
+            // NOTE(michiel): Phase one minimizes the sum of the artificials, expressed in the non-basic columns
+            for (u32 column = 0; column < tableau.stride; ++column)
+            {
+                if ((column < tableau.firstArtificial) || (column >= tableau.columnCount))
+                {
+                    costRow[column] -= row[column];
+                }
+            }
+        }
+    }
+
+    program->iterationCount = 0;
+    u32 maxIterations = SIMPLEX_PIVOTS_PER_SIZE * (rowCount + tableau.columnCount);
+    if (artificialCount)
+    {
+        // NOTE(michiel): Phase one is bounded by zero, it can only run into the iteration limit
+        result = simplex_iterate(&tableau, tableau.firstArtificial, &program->iterationCount, maxIterations);
+        if ((result == LinearProgram_Optimal) && (-costRow[tableau.columnCount + 1] > 1.0e-7))
+        {
+            result = LinearProgram_Infeasible;
+        }
+        else if (result == LinearProgram_Optimal)
+        {
+            // NOTE(michiel): Drive the artificials that are still basic (at zero) out, rows where that is not
+            // possible are redundant and keep their artificial at zero.
+            for (u32 rowIdx = 0; rowIdx < rowCount; ++rowIdx)
+            {
+                if (tableau.basis[rowIdx] >= tableau.firstArtificial)
+                {
+                    f64 *row = tableau.values + (umm)rowIdx * tableau.stride;
+                    for (u32 column = 0; column < tableau.firstArtificial; ++column)
+                    {
+                        if ((row[column] > SIMPLEX_EPSILON) || (row[column] < -SIMPLEX_EPSILON))
+                        {
+                            simplex_pivot(&tableau, rowIdx, column);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (result == LinearProgram_Optimal)
+    {
+        for (u32 column = 0; column < tableau.stride; ++column)
+        {
+            costRow[column] = (column < variableCount) ? program->objective[column] : 0.0;
+        }
+        for (u32 rowIdx = 0; rowIdx < rowCount; ++rowIdx)
+        {
+            u32 basic = tableau.basis[rowIdx];
+            f64 cost = (basic < variableCount) ? program->objective[basic] : 0.0;
+            if (cost != 0.0)
+            {
+                f64 *row = tableau.values + (umm)rowIdx * tableau.stride;
+                for (u32 column = 0; column < tableau.stride; ++column)
+                {
+                    costRow[column] -= cost * row[column];
+                }
+            }
+        }
+
+        result = simplex_iterate(&tableau, tableau.firstArtificial, &program->iterationCount, maxIterations);
+    }
+
+    if (result == LinearProgram_Optimal)
+    {
+        for (u32 column = 0; column < variableCount; ++column)
+        {
+            program->solution[column] = 0.0;
+        }
+        for (u32 rowIdx = 0; rowIdx < rowCount; ++rowIdx)
+        {
+            u32 basic = tableau.basis[rowIdx];
+            if (basic < variableCount)
+            {
+                // NOTE(michiel): The basis is optimal for the perturbed program, rounding can leave the exact value
+                // a hair below zero
+                f64 value = tableau.values[(umm)rowIdx * tableau.stride + tableau.columnCount + 1];
+                program->solution[basic] = (value > 0.0) ? value : 0.0;
+            }
+        }
+        program->objectiveValue = -costRow[tableau.columnCount + 1];
+
+        for (u32 rowIdx = 0; rowIdx < rowCount; ++rowIdx)
+        {
+            program->duals[rowIdx] = dualFactors[rowIdx] * costRow[dualColumns[rowIdx]];
+        }
+    }
+
+    free(dualFactors);
+    free(dualColumns);
+    free(tableau.values);
+    free(tableau.basis);
+
+    return result;
+}
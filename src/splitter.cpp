@@ -5,26 +5,379 @@
 #include <x86intrin.h>
 #endif
 
+#include <string.h>
+
 #include "../libberdip/src/common.h"
 #include "../libberdip/src/maps.h"
 #include "../libberdip/src/maths.h"
 #include "../libberdip/src/strings.h"
 #include "../libberdip/src/files.h"
 
+// NOTE(michiel): Finds the smallest network of 1:2 and 1:3 splitters that splits a source belt into the target
+// rates. Every belt in a network carries a fraction n / (2^a 3^b) of the source, so fractions are kept exactly as a
+// numerator over FRACTION_ONE. A configuration is the sorted list of belt fractions after some splits, the search
+// goes breadth first over the splitter count and remembers every configuration it has seen, so the many orders of
+// doing the same splits are only expanded once.
+// When a configuration is done splitting, its belts get merged into the targets. Belts can also be merged back
+// into the source (loopback), which scales all other belts up by 1 / (1 - loopback) and reaches fractions like 1/5.
+
+#define MAX_SPLITTER_COUNT  10
+#define MAX_BELT_COUNT      (2 * MAX_SPLITTER_COUNT + 1)
+#define MAX_TARGET_COUNT    8
+#define MAX_CONFIGURATIONS  (1 << 18)
+#define FRACTION_ONE        (1024ull * 59049ull) // NOTE(michiel): 2^10 * 3^10
+
+struct SplitConfig
+{
+    u32 parent;
+    u8 splitBelt;   // NOTE(michiel): Index into the sorted belts of the parent
+    u8 ways;        // NOTE(michiel): 2 or 3, 0 for the source
+    u8 beltCount;
+    u64 belts[MAX_BELT_COUNT];
+};
+
+struct SplitSearch
+{
+    f64 epsilon;
+    u32 targetCount;
+    f64 targets[MAX_TARGET_COUNT + 1]; // NOTE(michiel): Fractions of the source, the last one can be the leftover
+
+    u32 configCount;
+    u32 maxConfigCount;
+    SplitConfig *configs;
+
+    u32 mapMask;
+    u32 *map;               // NOTE(michiel): Config index + 1, 0 is an empty slot
+
+    // NOTE(michiel): Assignment of the belts of the found configuration, MAX_TARGET_COUNT + 1 means loopback
+    u8 groups[MAX_BELT_COUNT];
+    u8 bestGroups[MAX_BELT_COUNT];
+};
+
+internal u32
+hash_config(SplitConfig *config)
+{
+    // NOTE(michiel): FNV-1a over the fractions
+    u32 result = 2166136261u;
+    for (u32 beltIdx = 0; beltIdx < config->beltCount; ++beltIdx)
+    {
+        u64 belt = config->belts[beltIdx];
+        for (u32 byteIdx = 0; byteIdx < 8; ++byteIdx)
+        {
+            result ^= (u8)(belt >> (byteIdx * 8));
+            result *= 16777619u;
+        }
+    }
+    return result;
+}
+
+internal b32
+config_equal(SplitConfig *a, SplitConfig *b)
+{
+    return (a->beltCount == b->beltCount) && (memcmp(a->belts, b->belts, sizeof(u64) * a->beltCount) == 0);
+}
+
+// NOTE(michiel): Adds the config if it was not seen before, returns false if it was or the search is full
+internal b32
+add_config(SplitSearch *search, SplitConfig *config)
+{
+    b32 result = false;
+    u32 slotIdx = hash_config(config) & search->mapMask;
+    while (search->map[slotIdx] && !config_equal(search->configs + search->map[slotIdx] - 1, config))
+    {
+        slotIdx = (slotIdx + 1) & search->mapMask;
+    }
+
+    if (!search->map[slotIdx] && (search->configCount < MAX_CONFIGURATIONS))
+    {
+        if (search->configCount == search->maxConfigCount)
+        {
+            search->maxConfigCount = search->maxConfigCount ? 2 * search->maxConfigCount : 4096;
+            search->configs = (SplitConfig *)realloc(search->configs, sizeof(SplitConfig) * search->maxConfigCount);
+        }
+        search->configs[search->configCount++] = *config;
+        search->map[slotIdx] = search->configCount;
+        result = true;
+    }
+    return result;
+}
+
+internal void
+split_belt(SplitConfig *source, u32 beltIdx, u32 ways, SplitConfig *dest)
+{
+    u64 part = source->belts[beltIdx] / ways;
+    dest->beltCount = 0;
+    for (u32 idx = 0; idx < source->beltCount; ++idx)
+    {
+        if (idx != beltIdx)
+        {
+            dest->belts[dest->beltCount++] = source->belts[idx];
+        }
+    }
+    for (u32 way = 0; way < ways; ++way)
+    {
+        dest->belts[dest->beltCount++] = part;
+    }
+
+    // NOTE(michiel): Sorted large to small, insertion sort is plenty for a handful of belts
+    for (u32 idx = 1; idx < dest->beltCount; ++idx)
+    {
+        u64 value = dest->belts[idx];
+        u32 at = idx;
+        while (at && (dest->belts[at - 1] < value))
+        {
+            dest->belts[at] = dest->belts[at - 1];
+            --at;
+        }
+        dest->belts[at] = value;
+    }
+}
+
+// NOTE(michiel): Tries to put every belt in a target group or in the loopback. Equal belts are interchangeable, so
+// a belt never goes to a lower group than an equal belt before it.
+internal b32
+assign_belts(SplitSearch *search, SplitConfig *config, u32 beltIdx, f64 *groupSums, f64 loopback)
+{
+    b32 result = false;
+    if (beltIdx == config->beltCount)
+    {
+        result = loopback < 1.0 - search->epsilon;
+        for (u32 targetIdx = 0; result && (targetIdx < search->targetCount); ++targetIdx)
+        {
+            f64 reached = groupSums[targetIdx] / (1.0 - loopback);
+            f64 error = reached - search->targets[targetIdx];
+            result = (error <= search->epsilon) && (error >= -search->epsilon);
+        }
+    }
+    else
+    {
+        f64 belt = (f64)config->belts[beltIdx] / (f64)FRACTION_ONE;
+        u32 minGroup = 0;
+        if (beltIdx && (config->belts[beltIdx] == config->belts[beltIdx - 1]))
+        {
+            minGroup = search->groups[beltIdx - 1];
+        }
+
+        for (u32 group = minGroup; !result && (group < search->targetCount); ++group)
+        {
+            // NOTE(michiel): A loopback only ever shrinks what a group has to carry
+            if (groupSums[group] + belt <= search->targets[group] + search->epsilon)
+            {
+                search->groups[beltIdx] = (u8)group;
+                groupSums[group] += belt;
+                result = assign_belts(search, config, beltIdx + 1, groupSums, loopback);
+                groupSums[group] -= belt;
+            }
+        }
+        if (!result)
+        {
+            search->groups[beltIdx] = MAX_TARGET_COUNT + 1;
+            result = assign_belts(search, config, beltIdx + 1, groupSums, loopback + belt);
+        }
+    }
+    return result;
+}
+
+// NOTE(michiel): Returns the index of the first configuration (in splitter count order) that reaches the targets, or
+// -1 if none does within MAX_SPLITTER_COUNT splitters or the configuration budget.
+internal s32
+search_splitters(SplitSearch *search)
+{
+    s32 result = -1;
+
+    SplitConfig root = {};
+    root.beltCount = 1;
+    root.belts[0] = FRACTION_ONE;
+    add_config(search, &root);
+
+    u32 levelStart = 0;
+    for (u32 splitterCount = 0; (result < 0) && (splitterCount <= MAX_SPLITTER_COUNT); ++splitterCount)
+    {
+        u32 levelEnd = search->configCount;
+        for (u32 configIdx = levelStart; (result < 0) && (configIdx < levelEnd); ++configIdx)
+        {
+            f64 groupSums[MAX_TARGET_COUNT + 1] = {};
+            if ((search->configs[configIdx].beltCount >= search->targetCount) &&
+                assign_belts(search, search->configs + configIdx, 0, groupSums, 0.0))
+            {
+                result = configIdx;
+                memcpy(search->bestGroups, search->groups, sizeof(search->groups));
+            }
+        }
+
+        if ((result < 0) && (splitterCount < MAX_SPLITTER_COUNT))
+        {
+            for (u32 configIdx = levelStart; configIdx < levelEnd; ++configIdx)
+            {
+                SplitConfig *config = search->configs + configIdx;
+                for (u32 beltIdx = 0; beltIdx < config->beltCount; ++beltIdx)
+                {
+                    if (beltIdx && (config->belts[beltIdx] == config->belts[beltIdx - 1]))
+                    {
+                        continue;
+                    }
+                    for (u32 ways = 2; ways <= 3; ++ways)
+                    {
+                        if ((config->belts[beltIdx] % ways) == 0)
+                        {
+                            SplitConfig next;
+                            next.parent = configIdx;
+                            next.splitBelt = (u8)beltIdx;
+                            next.ways = (u8)ways;
+                            split_belt(config, beltIdx, ways, &next);
+                            add_config(search, &next);
+                            config = search->configs + configIdx;
+                        }
+                    }
+                }
+            }
+        }
+        levelStart = levelEnd;
+    }
+
+    return result;
+}
+
+struct NamedBelt
+{
+    u64 fraction;
+    u32 splitter;   // NOTE(michiel): 0 for the source
+    u32 output;
+    b32 split;
+};
+
+internal void
+print_splitters(SplitSearch *search, s32 found, f64 inputRate, u32 outputCount, f64 *targetRates)
+{
+    // NOTE(michiel): Replay the splits from the source, any belt with the right fraction will do
+    u32 chain[MAX_SPLITTER_COUNT + 1];
+    u32 chainCount = 0;
+    for (u32 configIdx = found; configIdx; configIdx = search->configs[configIdx].parent)
+    {
+        chain[chainCount++] = configIdx;
+    }
+
+    // NOTE(michiel): Belts that loop back make the network run faster than the source alone
+    SplitConfig *config = search->configs + found;
+    f64 loopback = 0.0;
+    for (u32 configBelt = 0; configBelt < config->beltCount; ++configBelt)
+    {
+        if (search->bestGroups[configBelt] == MAX_TARGET_COUNT + 1)
+        {
+            loopback += (f64)config->belts[configBelt] / (f64)FRACTION_ONE;
+        }
+    }
+    f64 scale = inputRate / (1.0 - loopback);
+
+    NamedBelt belts[MAX_BELT_COUNT + MAX_SPLITTER_COUNT];
+    u32 beltCount = 0;
+    belts[beltCount++] = {FRACTION_ONE, 0, 0, false};
+
+    if (loopback > 0.0) {
+        fprintf(stdout, "Source: %.2f per minute (%.2f with the loopback), %u splitter%s\n", inputRate, scale,
+                chainCount, chainCount == 1 ? "" : "s");
+    } else {
+        fprintf(stdout, "Source: %.2f per minute, %u splitter%s\n", inputRate, chainCount, chainCount == 1 ? "" : "s");
+    }
+    for (u32 splitterIdx = 0; splitterIdx < chainCount; ++splitterIdx)
+    {
+        SplitConfig *step = search->configs + chain[chainCount - splitterIdx - 1];
+        SplitConfig *parent = search->configs + step->parent;
+        u64 fraction = parent->belts[step->splitBelt];
+
+        u32 beltIdx = 0;
+        while (belts[beltIdx].split || (belts[beltIdx].fraction != fraction))
+        {
+            ++beltIdx;
+        }
+        belts[beltIdx].split = true;
+        if (belts[beltIdx].splitter) {
+            fprintf(stdout, "  S%u: 1:%u splitter on S%u.%u (%.2f per minute)\n", splitterIdx + 1, step->ways,
+                    belts[beltIdx].splitter, belts[beltIdx].output, scale * fraction / FRACTION_ONE);
+        } else {
+            fprintf(stdout, "  S%u: 1:%u splitter on the source (%.2f per minute)\n", splitterIdx + 1, step->ways,
+                    scale * fraction / FRACTION_ONE);
+        }
+        for (u32 way = 0; way < step->ways; ++way)
+        {
+            belts[beltCount++] = {fraction / step->ways, splitterIdx + 1, way + 1, false};
+        }
+    }
+
+    b32 used[MAX_BELT_COUNT + MAX_SPLITTER_COUNT] = {};
+    u32 beltGroups[MAX_BELT_COUNT + MAX_SPLITTER_COUNT];
+    for (u32 configBelt = 0; configBelt < config->beltCount; ++configBelt)
+    {
+        u32 beltIdx = 0;
+        while (belts[beltIdx].split || used[beltIdx] || (belts[beltIdx].fraction != config->belts[configBelt]))
+        {
+            ++beltIdx;
+        }
+        used[beltIdx] = true;
+        beltGroups[beltIdx] = search->bestGroups[configBelt];
+    }
+
+    // NOTE(michiel): Mergers take up to 3 inputs, the loopback merges into the source
+    u32 mergerCount = 0;
+    for (u32 group = 0; group <= search->targetCount; ++group)
+    {
+        b32 isLoopback = group == search->targetCount;
+        u32 groupId = isLoopback ? MAX_TARGET_COUNT + 1 : group;
+        u32 inputCount = isLoopback ? 1 : 0;
+        f64 reached = 0.0;
+        for (u32 beltIdx = 0; beltIdx < beltCount; ++beltIdx)
+        {
+            if (used[beltIdx] && (beltGroups[beltIdx] == groupId))
+            {
+                ++inputCount;
+                reached += scale * belts[beltIdx].fraction / FRACTION_ONE;
+            }
+        }
+        if (isLoopback && (inputCount == 1))
+        {
+            continue;
+        }
+
+        u32 groupMergers = (inputCount > 1) ? inputCount / 2 : 0;
+        mergerCount += groupMergers;
+        if (isLoopback) {
+            fprintf(stdout, "  loopback into the source: %.2f per minute (", reached);
+        } else if (group < outputCount) {
+            fprintf(stdout, "  output %u: %.2f per minute, target %.2f (", group + 1, reached, targetRates[group]);
+        } else {
+            fprintf(stdout, "  leftover: %.2f per minute (", reached);
+        }
+
+        b32 first = true;
+        for (u32 beltIdx = 0; beltIdx < beltCount; ++beltIdx)
+        {
+            if (used[beltIdx] && (beltGroups[beltIdx] == groupId))
+            {
+                if (belts[beltIdx].splitter) {
+                    fprintf(stdout, "%sS%u.%u", first ? "" : " + ", belts[beltIdx].splitter, belts[beltIdx].output);
+                } else {
+                    fprintf(stdout, "%ssource", first ? "" : " + ");
+                }
+                first = false;
+            }
+        }
+        if (groupMergers) {
+            fprintf(stdout, ", %u merger%s", groupMergers, groupMergers == 1 ? "" : "s");
+        }
+        fprintf(stdout, ")\n");
+    }
+    fprintf(stdout, "Total: %u splitter%s, %u merger%s\n", chainCount, chainCount == 1 ? "" : "s",
+            mergerCount, mergerCount == 1 ? "" : "s");
+}
+
 int main(int argc, char **argv)
 {
+    int result = 0;
     if (argc > 1)
     {
         f32 epsilon = 0.001f;
         String ratioStr = string(argv[1]);
-        
-        u32 colonIndex = 0;
-        while ((colonIndex < ratioStr.size) &&
-               (ratioStr.data[colonIndex] != ':'))
-        {
-            ++colonIndex;
-        }
-        
+
         if (argc > 2)
         {
             f32 newEps = float_from_string(string(argv[2]));
@@ -37,43 +390,124 @@ int main(int argc, char **argv)
                 fprintf(stderr, "Epsilon value out of range (%f), continuing with %f\n", newEps, epsilon);
             }
         }
-        
-        if (colonIndex < ratioStr.size)
+
+        // NOTE(michiel): input:output[:output...], the rates are items per minute
+        f64 rates[MAX_TARGET_COUNT + 2];
+        u32 rateCount = 0;
+        b32 valid = true;
+        while (valid && ratioStr.size)
+        {
+            u32 colonIndex = 0;
+            while ((colonIndex < ratioStr.size) && (ratioStr.data[colonIndex] != ':'))
+            {
+                ++colonIndex;
+            }
+
+            String rateStr = {colonIndex, ratioStr.data};
+            if (!rateStr.size)
+            {
+                fprintf(stderr, "ERROR: Missing %s in ratio!\n", rateCount ? "output" : "input");
+                valid = false;
+            }
+            else if (rateCount == array_count(rates) - 1)
+            {
+                fprintf(stderr, "ERROR: More than %u outputs in ratio!\n", MAX_TARGET_COUNT);
+                valid = false;
+            }
+            else
+            {
+                rates[rateCount++] = float_from_string(rateStr);
+            }
+
+            ratioStr.size -= colonIndex;
+            ratioStr.data += colonIndex;
+            if (ratioStr.size)
+            {
+                // NOTE(michiel): Skip the colon, a trailing one means a missing output
+                --ratioStr.size;
+                ++ratioStr.data;
+                if (!ratioStr.size)
+                {
+                    fprintf(stderr, "ERROR: Missing output in ratio!\n");
+                    valid = false;
+                }
+            }
+        }
+
+        if (valid && (rateCount < 2))
         {
-            String inputRateStr = {colonIndex, ratioStr.data};
-            String outputRateStr = {ratioStr.size - colonIndex - 1, ratioStr.data + colonIndex + 1};
-            
-            if (inputRateStr.size)
+            fprintf(stderr, "ERROR: Missing colon in ratio!\n");
+            valid = false;
+        }
+
+        if (valid)
+        {
+            f64 inputRate = rates[0];
+            f64 *targetRates = rates + 1;
+            u32 targetCount = rateCount - 1;
+
+            SplitSearch search = {};
+            search.epsilon = epsilon;
+            f64 total = 0.0;
+            for (u32 targetIdx = 0; targetIdx < targetCount; ++targetIdx)
             {
-                if (outputRateStr.size)
+                search.targets[search.targetCount++] = targetRates[targetIdx] / inputRate;
+                total += search.targets[targetIdx];
+            }
+
+            if ((inputRate <= 0.0) || (total > 1.0 + epsilon))
+            {
+                fprintf(stderr, "ERROR: The outputs (%f) need more than the input (%f)!\n", total * inputRate, inputRate);
+                valid = false;
+            }
+            else
+            {
+                if (total < 1.0 - epsilon)
+                {
+                    // NOTE(michiel): Whatever is left goes on its own belt
+                    search.targets[search.targetCount++] = 1.0 - total;
+                }
+
+                search.mapMask = 2 * MAX_CONFIGURATIONS - 1;
+                search.map = (u32 *)calloc(search.mapMask + 1, sizeof(u32));
+
+                fprintf(stdout, "In: %f, Out:", inputRate);
+                for (u32 targetIdx = 0; targetIdx < targetCount; ++targetIdx)
+                {
+                    fprintf(stdout, " %f", targetRates[targetIdx]);
+                }
+                fprintf(stdout, "\n");
+
+                s32 found = search_splitters(&search);
+                if (found >= 0)
                 {
-                    f64 inputRate = float_from_string(inputRateStr);
-                    f64 outputRate = float_from_string(outputRateStr);
-                    
-                    fprintf(stdout, "In: %f, Out: %f\n", inputRate, outputRate);
-                    
+                    print_splitters(&search, found, inputRate, targetCount, targetRates);
                 }
                 else
                 {
-                    fprintf(stderr, "ERROR: Missing output in ratio!\nUsage: %s <ratio input:output> [epsilon 0.001]\n", argv[0]);
+                    fprintf(stderr, "No network of at most %u splitters reaches the outputs within %f (searched %u configurations)\n",
+                            MAX_SPLITTER_COUNT, epsilon, search.configCount);
+                    result = 1;
                 }
-            }
-            else
-            {
-                fprintf(stderr, "ERROR: Missing input in ratio!\nUsage: %s <ratio input:output> [epsilon 0.001]\n", argv[0]);
+
+                free(search.configs);
+                free(search.map);
             }
         }
-        else
+
+        if (!valid)
         {
-            fprintf(stderr, "ERROR: Missing colon in ratio!\nUsage: %s <ratio input:output> [epsilon 0.001]\n", argv[0]);
+            fprintf(stderr, "Usage: %s <ratio input:output[:output...]> [epsilon 0.001]\n", argv[0]);
+            result = 1;
         }
     }
     else
     {
-        fprintf(stderr, "Usage: %s <ratio input:output> [epsilon 0.001]\n", argv[0]);
+        fprintf(stderr, "Usage: %s <ratio input:output[:output...]> [epsilon 0.001]\n", argv[0]);
+        fprintf(stderr, "  finds the fewest 1:2 and 1:3 splitters (plus mergers and loopback) that split the input into the outputs\n");
     }
-    
-    return 0;
+
+    return result;
 }
 
 /*
@@ -92,6 +526,3 @@ digraph "splitting" {
    inB:c -> outC:c
 }
 */
-
-
-
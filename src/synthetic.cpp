@@ -0,0 +1,231 @@
+// NOTE(michiel): Generates random, but valid, recipe books for scaling tests. The items are spread over layers, the
+// first layer are raw resources and every other item gets a recipe (and maybe some alternates) with inputs from the
+// layers below it only, so every combination of recipes is a DAG. Byproducts are also taken from the lower layers.
+// The book is written in the text format and goes through parse_recipe_book, like a book on disk would.
+// Item n is called 'item n', the raw resources come first and the last item is at the top of the deepest tree.
+//
+// A spec is a comma separated list of key=value pairs, every key is optional:
+//   items=800         number of items, including the raw resources
+//   depth=7           number of layers above the raw resources, the longest chain of recipes
+//   fanin=4           maximum number of inputs per recipe
+//   byproducts=10     percentage of recipes with byproducts
+//   maxbyproducts=1   maximum number of byproducts for those recipes
+//   alternates=15     percentage of items with alternate recipes
+//   maxalternates=1   maximum number of alternates for those items
+//   seed=1            the same seed and spec always give the same book
+
+struct SyntheticSpec
+{
+    u32 itemCount;
+    u32 depth;
+    u32 maxFanIn;
+    u32 byproductPercent;
+    u32 maxByproducts;
+    u32 alternatePercent;
+    u32 maxAlternates;
+    u32 seed;
+};
+
+internal SyntheticSpec
+default_synthetic_spec(void)
+{
+    SyntheticSpec result = {};
+    result.itemCount = 800;
+    result.depth = 7;
+    result.maxFanIn = 4;
+    result.byproductPercent = 10;
+    result.maxByproducts = 1;
+    result.alternatePercent = 15;
+    result.maxAlternates = 1;
+    result.seed = 1;
+    return result;
+}
+
+internal b32
+parse_synthetic_spec(const char *text, SyntheticSpec *spec)
+{
+    b32 result = true;
+    *spec = default_synthetic_spec();
+
+    String rest = string(text);
+    while (result && rest.size)
+    {
+        String pair = trim_spaces(split_off(&rest, static_string(",")));
+        String key = trim_spaces(split_off(&pair, static_string("=")));
+        String value = trim_spaces(pair);
+        u32 number = 0;
+        for (u32 idx = 0; idx < value.size; ++idx)
+        {
+            if ((value.data[idx] < '0') || (value.data[idx] > '9') || (number > 100000000))
+            {
+                result = false;
+                break;
+            }
+            number = number * 10 + (value.data[idx] - '0');
+        }
+
+        u32 *setting = 0;
+        if (key == static_string("items")) {
+            setting = &spec->itemCount;
+        } else if (key == static_string("depth")) {
+            setting = &spec->depth;
+        } else if (key == static_string("fanin")) {
+            setting = &spec->maxFanIn;
+        } else if (key == static_string("byproducts")) {
+            setting = &spec->byproductPercent;
+        } else if (key == static_string("maxbyproducts")) {
+            setting = &spec->maxByproducts;
+        } else if (key == static_string("alternates")) {
+            setting = &spec->alternatePercent;
+        } else if (key == static_string("maxalternates")) {
+            setting = &spec->maxAlternates;
+        } else if (key == static_string("seed")) {
+            setting = &spec->seed;
+        }
+
+        result = result && value.size && setting;
+        if (result)
+        {
+            *setting = number;
+        }
+        else
+        {
+            fprintf(stderr, "Bad generator setting '%.*s' in '%s'\n", STR_FMT(key), text);
+        }
+    }
+
+    if (result && ((spec->depth == 0) || (spec->itemCount < 2 * (spec->depth + 1)) || (spec->maxFanIn == 0) ||
+                   (spec->maxFanIn > spec->itemCount) || (spec->maxByproducts == 0) || (spec->maxAlternates == 0)))
+    {
+        fprintf(stderr, "The generator needs a depth of at least 1, 2 items per layer, a fan in of at least 1 and at "
+                "most the item count, and at least 1 byproduct and alternate\n");
+        result = false;
+    }
+    if (spec->seed == 0)
+    {
+        // NOTE(michiel): xorshift gets stuck on 0
+        spec->seed = 0x5A71C0DE;
+    }
+    return result;
+}
+
+internal u32
+next_synthetic_random(u32 *state)
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// NOTE(michiel): Layer 0 are the raw resources, layers 1 to depth have recipes
+internal u32
+get_synthetic_layer_start(SyntheticSpec *spec, u32 layer)
+{
+    return (u32)(((u64)layer * spec->itemCount) / (spec->depth + 1));
+}
+
+// NOTE(michiel): Quarters, so the rates are exact but not all whole numbers
+internal void
+output_synthetic_rate(OutputBuffer *buffer, u32 *random, u32 maxQuarters)
+{
+    u32 quarters = 1 + next_synthetic_random(random) % maxQuarters;
+    output_fmt(buffer, "%u", quarters / 4);
+    if (quarters % 4)
+    {
+        output_fmt(buffer, ".%u", 25 * (quarters % 4));
+    }
+}
+
+internal void
+generate_synthetic_book(OutputBuffer *buffer, SyntheticSpec *spec)
+{
+    output_string(buffer, static_string("building smelter, smelters, 4\n"
+                                        "building constructor, constructors, 4\n"
+                                        "building assembler, assemblers, 15\n"
+                                        "building manufacturer, manufacturers, 55\n"));
+    const char *buildings[] = {"smelter", "constructor", "assembler", "manufacturer"};
+
+    u32 random = spec->seed;
+    u32 *inputs = (u32 *)malloc(sizeof(u32) * spec->maxFanIn);
+    for (u32 layer = 1; layer <= spec->depth; ++layer)
+    {
+        u32 layerStart = get_synthetic_layer_start(spec, layer);
+        u32 layerEnd = get_synthetic_layer_start(spec, layer + 1);
+        u32 belowStart = get_synthetic_layer_start(spec, layer - 1);
+        for (u32 itemId = layerStart; itemId < layerEnd; ++itemId)
+        {
+            u32 recipeCount = 1;
+            if ((next_synthetic_random(&random) % 100) < spec->alternatePercent)
+            {
+                recipeCount += 1 + next_synthetic_random(&random) % spec->maxAlternates;
+            }
+
+            for (u32 recipeIdx = 0; recipeIdx < recipeCount; ++recipeIdx)
+            {
+                u32 inputCount = 1 + next_synthetic_random(&random) % spec->maxFanIn;
+
+                // NOTE(michiel): The first input is from the layer right below, so the depth is what was asked for.
+                // The others are from any layer below, without duplicates.
+                inputs[0] = belowStart + next_synthetic_random(&random) % (layerStart - belowStart);
+                u32 uniqueCount = 1;
+                for (u32 inputIdx = 1; inputIdx < inputCount; ++inputIdx)
+                {
+                    u32 input = next_synthetic_random(&random) % layerStart;
+                    b32 duplicate = false;
+                    for (u32 testIdx = 0; testIdx < uniqueCount; ++testIdx)
+                    {
+                        duplicate = duplicate || (inputs[testIdx] == input);
+                    }
+                    if (!duplicate)
+                    {
+                        inputs[uniqueCount++] = input;
+                    }
+                }
+
+                // NOTE(michiel): The big machines take the recipes with the most inputs
+                u32 building = (uniqueCount < array_count(buildings)) ? uniqueCount - 1 : array_count(buildings) - 1;
+                output_fmt(buffer, "%s: ", buildings[building]);
+                output_synthetic_rate(buffer, &random, 240);
+                output_fmt(buffer, " item %u", itemId);
+                if ((next_synthetic_random(&random) % 100) < spec->byproductPercent)
+                {
+                    u32 byproductCount = 1 + next_synthetic_random(&random) % spec->maxByproducts;
+                    for (u32 byproductIdx = 0; byproductIdx < byproductCount; ++byproductIdx)
+                    {
+                        output_string(buffer, static_string(", "));
+                        output_synthetic_rate(buffer, &random, 120);
+                        output_fmt(buffer, " item %u", next_synthetic_random(&random) % layerStart);
+                    }
+                }
+                output_string(buffer, static_string(" <-"));
+                for (u32 inputIdx = 0; inputIdx < uniqueCount; ++inputIdx)
+                {
+                    output_string(buffer, inputIdx ? static_string(", ") : static_string(" "));
+                    output_synthetic_rate(buffer, &random, 240);
+                    output_fmt(buffer, " item %u", inputs[inputIdx]);
+                }
+                output_string(buffer, static_string("\n"));
+            }
+        }
+    }
+    free(inputs);
+}
+
+// NOTE(michiel): Raw resources only show up as inputs, so the ones no recipe picked do not exist in the calculator
+internal b32
+load_synthetic_book(Calculator *calculator, SyntheticSpec *spec)
+{
+    OutputBuffer buffer = {};
+    generate_synthetic_book(&buffer, spec);
+    String text = {buffer.size, buffer.data};
+    b32 result = parse_recipe_book(calculator, static_string("generated"), text);
+    if (result)
+    {
+        build_recipe_index(calculator);
+    }
+    free(buffer.data);
+    return result;
+}